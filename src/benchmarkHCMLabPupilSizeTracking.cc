@@ -0,0 +1,163 @@
+/**
+ * End-to-end throughput benchmark of the single eye pupil tracking on synthetic eye videos.
+ *
+ * Renders a synthetic eye video into memory (so decoding and rendering are not timed), then runs all of its frames
+ * through HCMLabPupilDetector and through HCMLabSingleEyePupilTracker.
+ * Reports the frame rate, the median and 99th percentile latency per frame, how many pupils were found
+ * and how far their diameters are off from the rendered ones.
+ **/
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "util/hcmutils.h"
+#include "util/hcmsyntheticeyevideo.h"
+#include "hcmlabpupildetector.h"
+#include "hcmlabsingleeyepupiltracker.h"
+
+#include "mediapipe/framework/port/commandlineflags.h"
+
+DEFINE_int32(width, 192, "Width of the synthetic eye crops in pixels.");
+
+DEFINE_int32(height, 144, "Height of the synthetic eye crops in pixels.");
+
+DEFINE_int32(frames, 600, "Number of frames of the synthetic eye video.");
+
+DEFINE_string(dilation_curve,
+"sine",
+"How the pupil diameter changes over time: 'constant', 'sine', 'light_reflex' or 'random_walk'.");
+
+DEFINE_int32(glints, 1, "Number of corneal reflections around the pupil.");
+
+DEFINE_double(eyelid_occlusion, 0, "Fraction (0 to 1) of the pupil's diameter that is covered by the upper eyelid.");
+
+DEFINE_double(blink_interval, 0, "Seconds between two blinks. 0 (default) never blinks.");
+
+DEFINE_double(blur, 1, "Sigma of the gaussian defocus blur in pixels.");
+
+DEFINE_double(noise, 4, "Standard deviation of the sensor noise in gray values.");
+
+DEFINE_int32(seed, 1, "Seed of the random numbers of the synthetic eye video.");
+
+DEFINE_bool(fast_gradients,
+false,
+"Whether the pupil detection should compute its image gradients with a faster, approximate integer filter "
+"instead of the reference float Sobel filters. False by default");
+
+struct ThroughputStats
+{
+    std::vector<double> latencies; // per frame, in milliseconds
+    std::vector<float> diameterErrors; // absolute, in pixels. Only for frames where a pupil was found
+    double seconds = 0;
+};
+
+static double percentile(std::vector<double> values, double p)
+{
+    if (values.empty())
+        return 0;
+    size_t index = std::min(values.size() - 1, static_cast<size_t>(p * values.size()));
+    std::nth_element(values.begin(), values.begin() + index, values.end());
+    return values[index];
+}
+
+static void addFrame(ThroughputStats &stats, std::chrono::steady_clock::duration duration, float diameter, float confidence, float trueDiameter)
+{
+    double milliseconds = std::chrono::duration<double, std::milli>(duration).count();
+    stats.latencies.push_back(milliseconds);
+    stats.seconds += milliseconds / 1000;
+    if (confidence > 0 && diameter > 0)
+        stats.diameterErrors.push_back(std::abs(diameter - trueDiameter));
+}
+
+static void printStats(const std::string &label, const ThroughputStats &stats)
+{
+    double meanError = 0;
+    for (float error : stats.diameterErrors)
+        meanError += error;
+    if (!stats.diameterErrors.empty())
+        meanError /= stats.diameterErrors.size();
+
+    std::vector<double> errors(stats.diameterErrors.begin(), stats.diameterErrors.end());
+    std::cout << std::fixed << std::setprecision(3)
+              << label << "\n"
+              << "    frames: " << stats.latencies.size()
+              << ", fps: " << (stats.seconds > 0 ? stats.latencies.size() / stats.seconds : 0) << "\n"
+              << "    latency per frame [ms]: p50 " << percentile(stats.latencies, 0.5)
+              << ", p99 " << percentile(stats.latencies, 0.99)
+              << ", max " << percentile(stats.latencies, 1.0) << "\n"
+              << "    pupils found: " << stats.diameterErrors.size()
+              << ", diameter error [px]: mean " << meanError
+              << ", p50 " << percentile(errors, 0.5)
+              << ", p99 " << percentile(errors, 0.99) << "\n";
+}
+
+int main(int argc, char **argv)
+{
+    gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+    SyntheticEyeVideoConfig config;
+    if (!parsePupilDilationCurve(FLAGS_dilation_curve, config.dilationCurve)) {
+        hcmutils::logError("Unknown dilation curve " + FLAGS_dilation_curve);
+        return EXIT_FAILURE;
+    }
+    config.width = FLAGS_width;
+    config.height = FLAGS_height;
+    config.nrOfFrames = static_cast<size_t>(std::max(FLAGS_frames, 0));
+    config.nrOfGlints = FLAGS_glints;
+    config.eyelidOcclusion = FLAGS_eyelid_occlusion;
+    config.blinkInterval = FLAGS_blink_interval;
+    config.blurSigma = FLAGS_blur;
+    config.noiseSigma = FLAGS_noise;
+    config.seed = FLAGS_seed;
+
+    // render everything up front, so only the pupil tracking is timed
+    HCMSyntheticEyeVideo video(config);
+    std::vector<cv::Mat> frames;
+    std::vector<float> trueDiameters;
+    cv::Mat frame;
+    while (video.read(frame)) {
+        frames.push_back(frame.clone());
+        trueDiameters.push_back(video.pupilDiameter());
+    }
+    if (frames.empty()) {
+        hcmutils::logError("The synthetic eye video has no frames");
+        return EXIT_FAILURE;
+    }
+
+    ThroughputStats detectorStats;
+    HCMLabPupilDetector pupilDetector(FLAGS_fast_gradients);
+    for (size_t i = 0; i < frames.size(); i++) {
+        auto start = std::chrono::steady_clock::now();
+        RawPupilData pupil = pupilDetector.process(frames[i]);
+        auto end = std::chrono::steady_clock::now();
+        addFrame(detectorStats, end - start, pupil.diameter, pupil.confidence, trueDiameters[i]);
+    }
+
+    ThroughputStats trackerStats;
+    HCMLabSingleEyePupilTracker pupilTracker(config.width, config.height, config.fps, false, false, false,
+                                             "./", "synthetic", FLAGS_fast_gradients);
+    if (!pupilTracker.init()) {
+        hcmutils::logError("Could not initialize PupilTracker");
+        return EXIT_FAILURE;
+    }
+    for (size_t i = 0; i < frames.size(); i++) {
+        auto start = std::chrono::steady_clock::now();
+        PupilTrackingDataFrame pupils = pupilTracker.process(frames[i], i);
+        auto end = std::chrono::steady_clock::now();
+        addFrame(trackerStats, end - start, pupils.left.diameter, pupils.left.confidence, trueDiameters[i]);
+    }
+    pupilTracker.stop();
+
+    std::cout << "Synthetic eye video: " << config.width << "x" << config.height << ", " << frames.size() << " frames, "
+              << FLAGS_dilation_curve << " dilation, " << (FLAGS_fast_gradients ? "fast" : "reference") << " gradients\n";
+    printStats("HCMLabPupilDetector", detectorStats);
+    printStats("HCMLabSingleEyePupilTracker", trackerStats);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,110 @@
+/**
+ * Renders a synthetic infrared eye video with a dark elliptical pupil of known diameter.
+ *
+ * Writes an '.mp4' video and a '.csv' file with the true pupil diameter (in pixels) of every frame,
+ * so the pupil tracking can be benchmarked and checked without any recorded footage.
+ **/
+
+#include <algorithm>
+#include <cstdlib>
+#include <string>
+
+#include "util/hcmutils.h"
+#include "util/hcmsyntheticeyevideo.h"
+
+#include "mediapipe/framework/port/commandlineflags.h"
+
+DEFINE_string(output_path,
+"",
+"Full path of the '.mp4' video to render.");
+
+DEFINE_string(ground_truth_path,
+"",
+"Full path of the '.csv' file the true pupil diameter of each frame is written to. "
+"If not provided, the output path with the extension '.csv' is used.");
+
+DEFINE_int32(width, 192, "Width of the frames in pixels.");
+
+DEFINE_int32(height, 144, "Height of the frames in pixels.");
+
+DEFINE_double(fps, 30, "Frame rate of the video.");
+
+DEFINE_int32(frames, 600, "Number of frames to render.");
+
+DEFINE_bool(full_face,
+false,
+"Whether two eyes should be rendered into a face-like frame instead of a single eye crop. "
+"The pupil diameters are scaled down to the smaller eyes. False by default");
+
+DEFINE_double(min_pupil_diameter, 24, "Smallest pupil diameter in pixels of a single eye crop.");
+
+DEFINE_double(max_pupil_diameter, 48, "Largest pupil diameter in pixels of a single eye crop.");
+
+DEFINE_string(dilation_curve,
+"sine",
+"How the pupil diameter changes over time: 'constant', 'sine', 'light_reflex' or 'random_walk'.");
+
+DEFINE_double(dilation_period, 4, "Duration in seconds of one cycle of the dilation curve.");
+
+DEFINE_int32(glints, 1, "Number of corneal reflections around the pupil.");
+
+DEFINE_double(eyelid_occlusion, 0, "Fraction (0 to 1) of the pupil's diameter that is covered by the upper eyelid.");
+
+DEFINE_double(blink_interval, 0, "Seconds between two blinks. 0 (default) never blinks.");
+
+DEFINE_double(gaze_jitter, 2, "How far in pixels the pupil wanders from the center of the eye.");
+
+DEFINE_double(blur, 1, "Sigma of the gaussian defocus blur in pixels.");
+
+DEFINE_double(noise, 4, "Standard deviation of the sensor noise in gray values.");
+
+DEFINE_int32(seed, 1, "Seed of the random numbers. The same flags and seed always render the same video.");
+
+int main(int argc, char **argv)
+{
+    gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+    if (FLAGS_output_path == "") {
+        hcmutils::logError("Please provide the path of the video to render via the 'output_path' command line argument");
+        return EXIT_FAILURE;
+    }
+
+    SyntheticEyeVideoConfig config;
+    if (!parsePupilDilationCurve(FLAGS_dilation_curve, config.dilationCurve)) {
+        hcmutils::logError("Unknown dilation curve " + FLAGS_dilation_curve);
+        return EXIT_FAILURE;
+    }
+    config.width = FLAGS_width;
+    config.height = FLAGS_height;
+    config.fps = FLAGS_fps;
+    config.nrOfFrames = static_cast<size_t>(std::max(FLAGS_frames, 0));
+    config.fullFace = FLAGS_full_face;
+    config.minPupilDiameter = FLAGS_min_pupil_diameter;
+    config.maxPupilDiameter = FLAGS_max_pupil_diameter;
+    config.dilationPeriod = FLAGS_dilation_period;
+    config.nrOfGlints = FLAGS_glints;
+    config.eyelidOcclusion = FLAGS_eyelid_occlusion;
+    config.blinkInterval = FLAGS_blink_interval;
+    config.gazeJitter = FLAGS_gaze_jitter;
+    config.blurSigma = FLAGS_blur;
+    config.noiseSigma = FLAGS_noise;
+    config.seed = FLAGS_seed;
+
+    std::string groundTruthPath = FLAGS_ground_truth_path;
+    if (groundTruthPath == "") {
+        groundTruthPath = FLAGS_output_path;
+        size_t extension = groundTruthPath.rfind(".mp4");
+        if (extension != std::string::npos) {
+            groundTruthPath.erase(extension);
+        }
+        groundTruthPath += ".csv";
+    }
+
+    HCMSyntheticEyeVideo video(config);
+    if (!video.write(FLAGS_output_path, groundTruthPath)) {
+        return EXIT_FAILURE;
+    }
+
+    hcmutils::logInfo("Rendered " + FLAGS_output_path + " and " + groundTruthPath);
+    return EXIT_SUCCESS;
+}
@@ -1,6 +1,8 @@
 #include "hcmlabeyeextractor.h"
 
 #include "util/hcmutils.h"
+#include "util/hcmstagetimer.h"
+#include "util/hcmtracerecorder.h"
 
 #include <cstdlib>
 #include <sstream>
@@ -11,6 +13,7 @@
 #include <iostream>
 #include <cmath>
 
+#include "mediapipe/calculators/core/flow_limiter_calculator.pb.h"
 #include "mediapipe/framework/calculator_framework.h"
 #include "mediapipe/framework/formats/image_frame.h"
 #include "mediapipe/framework/formats/image_frame_opencv.h"
@@ -24,21 +27,33 @@
 #include "mediapipe/framework/port/status.h"
 
 HCMLabEyeExtractor::HCMLabEyeExtractor() :
-    m_currentLandmarksPacketIsEmpty(true),
-    m_currentLandmarksPacketTimestamp(0),
-    m_frameWaitIntervalMs(1),
-    m_maxWaitLoops(90)
+    m_landmarksPollerFinished(false),
+    m_maxFramesInFlight(1),
+    m_maxWaitTime(90),
+    m_irisTrackingGraphInitialized(false),
+    m_imageFrameBufferPool(std::make_shared<ImageFrameBufferPool>())
 {
 }
 
 HCMLabEyeExtractor::HCMLabEyeExtractor(double fps) :
-    m_currentLandmarksPacketIsEmpty(true),
-    m_currentLandmarksPacketTimestamp(0),
-    m_frameWaitIntervalMs(1),
-    m_maxWaitLoops(static_cast<size_t>(std::round(1000 / std::round(fps)))) /*make sure to not wait longer than one frame is allowed to take*/
+    HCMLabEyeExtractor(fps, 1)
 {
 }
 
+HCMLabEyeExtractor::HCMLabEyeExtractor(double fps, size_t maxFramesInFlight) :
+    m_landmarksPollerFinished(false),
+    m_maxFramesInFlight(std::max<size_t>(maxFramesInFlight, 1)),
+    m_irisTrackingGraphInitialized(false),
+    m_imageFrameBufferPool(std::make_shared<ImageFrameBufferPool>())
+{
+    setFps(fps);
+}
+
+void HCMLabEyeExtractor::setFps(double fps)
+{
+    m_maxWaitTime = std::chrono::milliseconds(static_cast<long>(std::round(1000 / std::round(fps)))); /*make sure to not wait longer than one frame is allowed to take*/
+}
+
 mediapipe::Status HCMLabEyeExtractor::initIrisTrackingGraph()
 {
     hcmutils::logInfo("Initialize the calculator graph.");
@@ -51,6 +66,17 @@ mediapipe::Status HCMLabEyeExtractor::initIrisTrackingGraph()
 
     mediapipe::CalculatorGraphConfig config = mediapipe::ParseTextProtoOrDie<mediapipe::CalculatorGraphConfig>(calculator_graph_config_contents);
 
+    // the graph's flow limiter drops every frame that arrives while another one is still being processed.
+    // Allow as many frames in flight as we are going to submit before collecting their landmarks.
+    for (auto &node : *config.mutable_node())
+    {
+        if (node.calculator() == "FlowLimiterCalculator")
+        {
+            auto *flowLimiterOptions = node.mutable_options()->MutableExtension(mediapipe::FlowLimiterCalculatorOptions::ext);
+            flowLimiterOptions->set_max_in_flight(m_maxFramesInFlight);
+        }
+    }
+
     auto initialized = m_irisTrackingGraph.Initialize(config);
 
     if (initialized.ok())
@@ -63,9 +89,20 @@ mediapipe::Status HCMLabEyeExtractor::initIrisTrackingGraph()
 
 mediapipe::Status HCMLabEyeExtractor::init()
 {
-    MP_RETURN_IF_ERROR(initIrisTrackingGraph());
+    if (!m_irisTrackingGraphInitialized)
+    {
+        MP_RETURN_IF_ERROR(initIrisTrackingGraph());
+        m_irisTrackingGraphInitialized = true;
+    }
     MP_RETURN_IF_ERROR(m_irisTrackingGraph.StartRun({}));
 
+    {
+        std::lock_guard<std::mutex> lock(m_pendingLandmarksPacketsMutex);
+        m_pendingLandmarksPackets.clear();
+        m_lastLandmarksPacket = mediapipe::Packet();
+        m_landmarksPollerFinished = false;
+    }
+
     std::thread pollerThread([&] {
         processLandmarkPackets(m_landmarksPoller);
     });
@@ -86,37 +123,58 @@ mediapipe::Status HCMLabEyeExtractor::stop()
 
 IrisDiameters HCMLabEyeExtractor::process(const cv::Mat &inputFrame, size_t framenr, cv::Mat &rightEye, cv::Mat &leftEye)
 {
-    //push inputFrame into graph
-    if (!pushFrameIntoGraph(inputFrame, framenr).ok())
+    if (!submit(inputFrame, framenr))
     {
-        hcmutils::logError("Could not push frame into graph!");
         return {-1.0f, -1.0f};
     }
 
-    //wait to allow the landmarksPacketPoller to get the data (if there is any)
-    int loopCount = 0;
+    return collect(inputFrame, framenr, rightEye, leftEye);
+}
+
+bool HCMLabEyeExtractor::submit(const cv::Mat &inputFrame, size_t framenr)
+{
+    HCMTraceScope traceScope("submit_frame", static_cast<int64_t>(framenr));
 
-    while ((m_currentLandmarksPacketIsEmpty || m_currentLandmarksPacketTimestamp < framenr) && loopCount < m_maxWaitLoops)
+    //push inputFrame into graph
+    if (!pushFrameIntoGraph(inputFrame, framenr).ok())
     {
-        std::this_thread::sleep_for(std::chrono::milliseconds(m_frameWaitIntervalMs));
-        loopCount++;
+        hcmutils::logError("Could not push frame into graph!");
+        return false;
     }
+    return true;
+}
 
-    mediapipe::Packet packetToUse;
+IrisDiameters HCMLabEyeExtractor::collect(const cv::Mat &inputFrame, size_t framenr, cv::Mat &rightEye, cv::Mat &leftEye)
+{
+    HCMTraceScope traceScope("collect_frame", static_cast<int64_t>(framenr));
 
-    if (loopCount < m_maxWaitLoops)
-    {
-        m_currentLandmarksPacketMutex.lock();
-        packetToUse = m_currentLandmarksPacket;
-        m_lastLandmarksPacket = m_currentLandmarksPacket;
-        m_currentLandmarksPacketIsEmpty = true;
-        m_currentLandmarksPacketMutex.unlock();
-    }
-    else
+    //wait until the landmarksPacketPoller hands over the data for this frame (if there is any)
+    //packets arrive in timestamp order, so as soon as any packet at or after framenr is there, we can stop waiting
+    mediapipe::Packet packetToUse;
     {
-        //use m_lastLandmarksPacket because the current one took way too long
-        std::cout << "Graph did not produce a packet for frame " << framenr << " in " << m_frameWaitIntervalMs * m_maxWaitLoops << "ms\n";
-        packetToUse = m_lastLandmarksPacket;
+        HCMStageTimer waitTimer(HCMStage::LANDMARK_WAIT);
+        std::unique_lock<std::mutex> lock(m_pendingLandmarksPacketsMutex);
+        m_landmarksPacketArrived.wait_for(lock, m_maxWaitTime, [&] {
+            return m_landmarksPollerFinished || (!m_pendingLandmarksPackets.empty() && m_pendingLandmarksPackets.rbegin()->first >= framenr);
+        });
+        waitTimer.stop();
+
+        auto packetForFrame = m_pendingLandmarksPackets.lower_bound(framenr);
+        if (packetForFrame != m_pendingLandmarksPackets.end())
+        {
+            packetToUse = packetForFrame->second;
+            m_lastLandmarksPacket = packetForFrame->second;
+        }
+        else
+        {
+            //use m_lastLandmarksPacket because the current one took way too long
+            std::cout << "Graph did not produce a packet for frame " << framenr << " in " << m_maxWaitTime.count() << "ms\n";
+            hcmtrace::recordInstant("graph_packet_missing");
+            packetToUse = m_lastLandmarksPacket;
+        }
+
+        //packets of this and earlier frames are not needed anymore
+        m_pendingLandmarksPackets.erase(m_pendingLandmarksPackets.begin(), m_pendingLandmarksPackets.upper_bound(framenr));
     }
 
     // dummy coordinates in case mediapipe can't give us any in time    
@@ -129,27 +187,56 @@ IrisDiameters HCMLabEyeExtractor::process(const cv::Mat &inputFrame, size_t fram
     if (!packetToUse.IsEmpty()) {
         eyesData = extractIrisData(packetToUse, inputFrame.cols, inputFrame.rows);
 
-        //dummy coordinates in case one eye is offscreen but mediapipe still "detected"/predicted its position
-        if (eyesData.left.centerX < 0 || eyesData.left.centerY < 0) {
+        //dummy coordinates in case one eye is offscreen (on any side) but mediapipe still "detected"/predicted its position
+        auto isOffscreen = [&](const IrisData &iris) {
+            return iris.centerX < 0 || iris.centerY < 0 || iris.centerX >= inputFrame.cols || iris.centerY >= inputFrame.rows;
+        };
+
+        if (isOffscreen(eyesData.left)) {
             eyesData.left = {0.4 * inputFrame.cols, 0.4 * inputFrame.rows, std::max(30.0, 0.01 * inputFrame.cols)};
         }
 
-        if (eyesData.right.centerX < 0 || eyesData.right.centerY < 0) {
+        if (isOffscreen(eyesData.right)) {
             eyesData.right = {0.6 * inputFrame.cols, 0.6 * inputFrame.rows, std::max(30.0, 0.01 * inputFrame.cols)};
         }
     }
 
-    renderCroppedEyeFrame(inputFrame, eyesData.right, rightEye);
-    renderCroppedEyeFrame(inputFrame, eyesData.left, leftEye);
+    bool rightEyeCropped = renderCroppedEyeFrame(inputFrame, eyesData.right, m_rightEyeScratch, rightEye);
+    bool leftEyeCropped = renderCroppedEyeFrame(inputFrame, eyesData.left, m_leftEyeScratch, leftEye);
+    if (!rightEyeCropped || !leftEyeCropped)
+    {
+        return {-1.0f, -1.0f};
+    }
 
     return {eyesData.left.diameter, eyesData.right.diameter};
 }
 
 mediapipe::Status HCMLabEyeExtractor::pushFrameIntoGraph(const cv::Mat &inputFrame, size_t timecode)
 {
-    auto mediapipeFrame = absl::make_unique<mediapipe::ImageFrame>(mediapipe::ImageFormat::SRGB, inputFrame.cols, inputFrame.rows, mediapipe::ImageFrame::kDefaultAlignmentBoundary);
-    cv::Mat mediapipeFrameAsMat = mediapipe::formats::MatView(mediapipeFrame.get());
-    inputFrame.copyTo(mediapipeFrameAsMat);
+    HCMStageTimer timer(HCMStage::PUSH_FRAME_INTO_GRAPH);
+
+    // The caller (e.g. the frame reader's ring) overwrites inputFrame's memory with later frames while the graph may still hold on to it,
+    // so it can't be handed to the graph directly. Instead of allocating a new ImageFrame per frame, the pixel buffers of
+    // ImageFrames the graph has released are refilled.
+    cv::Mat buffer;
+    {
+        std::lock_guard<std::mutex> lock(m_imageFrameBufferPool->mutex);
+        auto &freeBuffers = m_imageFrameBufferPool->freeBuffers;
+        if (!freeBuffers.empty())
+        {
+            buffer = freeBuffers.back();
+            freeBuffers.pop_back();
+        }
+    }
+    buffer.create(inputFrame.rows, inputFrame.cols, CV_8UC3); // only allocates if the video's size changed
+    inputFrame.copyTo(buffer);
+
+    std::shared_ptr<ImageFrameBufferPool> pool = m_imageFrameBufferPool;
+    auto mediapipeFrame = absl::make_unique<mediapipe::ImageFrame>(mediapipe::ImageFormat::SRGB, buffer.cols, buffer.rows, static_cast<int>(buffer.step), buffer.data,
+                                                                   [pool, buffer](uint8 *) {
+                                                                       std::lock_guard<std::mutex> lock(pool->mutex);
+                                                                       pool->freeBuffers.push_back(buffer);
+                                                                   });
 
     // Send image packet into the graph.
     MP_RETURN_IF_ERROR(m_irisTrackingGraph.AddPacketToInputStream(m_kInputStream, mediapipe::Adopt(mediapipeFrame.release()).At(mediapipe::Timestamp(timecode))));
@@ -160,6 +247,8 @@ mediapipe::Status HCMLabEyeExtractor::pushFrameIntoGraph(const cv::Mat &inputFra
 
 void HCMLabEyeExtractor::processLandmarkPackets(const std::unique_ptr<mediapipe::OutputStreamPoller> &poller)
 {
+    hcmtrace::setThreadName("landmark_poller");
+
     // poll for landmark packets
     while (true)
     {
@@ -174,21 +263,21 @@ void HCMLabEyeExtractor::processLandmarkPackets(const std::unique_ptr<mediapipe:
             if (!packet.IsEmpty())
             {
                 // std::cout << "packet at " << packet.Timestamp().Value() << "\n";
-                if (m_currentLandmarksPacketMutex.try_lock())
-                {
-                    m_currentLandmarksPacket = packet;
-                    m_currentLandmarksPacketIsEmpty = false;
-                    m_currentLandmarksPacketTimestamp = packet.Timestamp().Value();
-                    m_currentLandmarksPacketMutex.unlock();
-                }
-                else
                 {
-                    hcmutils::logError("Landmarkpacket was mutexed, couldn't write the latest one!");
-                    // do nothing to prevent deadlock :O
+                    std::lock_guard<std::mutex> lock(m_pendingLandmarksPacketsMutex);
+                    m_pendingLandmarksPackets[packet.Timestamp().Value()] = packet;
                 }
+                hcmtrace::recordInstant("landmarks_packet", packet.Timestamp().Value());
+                m_landmarksPacketArrived.notify_one();
             }
         }
     }
+
+    {
+        std::lock_guard<std::mutex> lock(m_pendingLandmarksPacketsMutex);
+        m_landmarksPollerFinished = true;
+    }
+    m_landmarksPacketArrived.notify_all();
 }
 
 /**
@@ -237,46 +326,48 @@ EyesData HCMLabEyeExtractor::extractIrisData(const mediapipe::Packet &landmarksP
     return {leftIrisData, rightIrisData, landmarksPacket.Timestamp().Value()};
 }
 
-bool HCMLabEyeExtractor::renderCroppedEyeFrame(const cv::Mat &camera_frame, const IrisData &irisData, cv::Mat &outputFrame)
+bool HCMLabEyeExtractor::renderCroppedEyeFrame(const cv::Mat &camera_frame, const IrisData &irisData, cv::Mat &scratchFrame, cv::Mat &outputFrame)
 {
-    auto maxEyeWidth = irisData.diameter * 2.0; //the iris is roughly 1/2 of the total eye size
+    HCMStageTimer timer(HCMStage::RENDER_CROPPED_EYE_FRAME);
 
-    auto outputSideLength = maxEyeWidth + 2.0 * m_eyeOutputVideoPadding;
-    cv::Size outputSize(outputSideLength, outputSideLength);
+    auto maxEyeWidth = irisData.diameter * 2.0; //the iris is roughly 1/2 of the total eye size
 
-    cv::Mat eyeOutputMat(outputSize, camera_frame.type());
-    eyeOutputMat = cv::Scalar(255, 0, 0); //fill with red;
+    int outputSideLength = static_cast<int>(maxEyeWidth + 2.0 * m_eyeOutputVideoPadding);
 
-    auto topLeftX = std::max(irisData.centerX - (maxEyeWidth / 2.0) - m_eyeOutputVideoPadding, 0.0);
-    auto topLeftY = std::max(irisData.centerY - (maxEyeWidth / 2.0) - m_eyeOutputVideoPadding, 0.0);
-    auto bottomRightX = std::min(irisData.centerX + (maxEyeWidth / 2.0) + m_eyeOutputVideoPadding, camera_frame.cols * 1.0);
-    auto bottomRightY = std::min(irisData.centerY + (maxEyeWidth / 2.0) + m_eyeOutputVideoPadding, camera_frame.rows * 1.0);
+    //ensure that the Iris center is always at the center of our output video
+    cv::Rect eyeWindow(cvRound(irisData.centerX - outputSideLength / 2.0),
+                       cvRound(irisData.centerY - outputSideLength / 2.0),
+                       outputSideLength,
+                       outputSideLength);
 
-    auto eyeCropWindowWidth = bottomRightX - topLeftX;
-    auto eyeCropWindowHeight = bottomRightY - topLeftY;
+    cv::Rect eyeSourceRoi = eyeWindow & cv::Rect(0, 0, camera_frame.cols, camera_frame.rows);
 
-    if (eyeCropWindowWidth > outputSideLength || eyeCropWindowHeight > outputSideLength)
+    if (eyeSourceRoi.empty())
     {
-        hcmutils::logError("Eyecropwindow is too big!");
+        // outputFrame must not keep referring to an earlier frame, whose memory may be reused by now
+        hcmutils::logError("Eyecropwindow is outside of the frame!");
+        scratchFrame.create(outputSideLength, outputSideLength, camera_frame.type());
+        scratchFrame = cv::Scalar(255, 0, 0);
+        outputFrame = scratchFrame;
         return false;
     }
 
-    cv::Rect eyeSourceRoi(topLeftX, topLeftY, eyeCropWindowWidth, eyeCropWindowHeight);
-    cv::Mat croppedEyeMat = camera_frame(eyeSourceRoi);
-
-    //ensure that the Iris center is always at the center of our output video
-    auto irisCenterInSourceRoiX = irisData.centerX - topLeftX;
-    auto irisCenterInSourceRoiY = irisData.centerY - topLeftY;
-    auto outputTopLeftCoordinateX = outputSideLength / 2.0 - irisCenterInSourceRoiX;
-    auto outputTopLeftCoordinateY = outputSideLength / 2.0 - irisCenterInSourceRoiY;
-
-    cv::Rect eyeTargetRoi(outputTopLeftCoordinateX, outputTopLeftCoordinateY, eyeCropWindowWidth, eyeCropWindowHeight);
-    cv::Mat eyeOutputTargetMat = eyeOutputMat(eyeTargetRoi);
-
-    croppedEyeMat.copyTo(eyeOutputTargetMat);
+    if (eyeSourceRoi == eyeWindow)
+    {
+        // common case: the eye lies fully inside the frame, so no pixels need to be copied at all
+        outputFrame = camera_frame(eyeSourceRoi);
+        return true;
+    }
 
-    outputFrame.resize(eyeOutputTargetMat.cols * eyeOutputTargetMat.rows);
-    eyeOutputTargetMat.copyTo(outputFrame);
+    // the eye is close to the frame's border, so the missing part is filled by replicating the border pixels.
+    // copyMakeBorder reuses scratchFrame's memory as long as the crop size stays the same
+    cv::copyMakeBorder(camera_frame(eyeSourceRoi), scratchFrame,
+                       eyeSourceRoi.y - eyeWindow.y,
+                       eyeWindow.br().y - eyeSourceRoi.br().y,
+                       eyeSourceRoi.x - eyeWindow.x,
+                       eyeWindow.br().x - eyeSourceRoi.br().x,
+                       cv::BORDER_REPLICATE | cv::BORDER_ISOLATED);
+    outputFrame = scratchFrame;
 
     return true;
-}
\ No newline at end of file
+}
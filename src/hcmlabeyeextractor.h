@@ -5,9 +5,11 @@
 #include <vector>
 #include <sstream>
 #include <memory>
+#include <map>
 #include <thread>
 #include <mutex>
-#include <atomic>
+#include <condition_variable>
+#include <chrono>
 
 #include "util/hcmdatatypes.h"
 
@@ -23,33 +25,63 @@
  * Renders the eyes into separate video files and writes the eye tracking data into a json file.
  * Paths to these 3 files are returned from the run() method.
  * 
- * Use a single instance of this class to process multiple videos one after another, by calling the run() method with different video files.
- * This saves the setup cost for the mediapipe graph that does the heavy face-tracking lifting.
+ * Use a single instance of this class to process multiple videos one after another, by calling init() and stop() around each video.
+ * The mediapipe graph that does the heavy face-tracking lifting is only parsed and initialized by the first init() call,
+ * later calls just start a new run of the same graph.
  */
 class HCMLabEyeExtractor
 {
 public:
     HCMLabEyeExtractor();
     HCMLabEyeExtractor(double fps);
+    HCMLabEyeExtractor(double fps, size_t maxFramesInFlight);
     ~HCMLabEyeExtractor(){};
 
+    /// Starts a run of the face-tracking graph. Initializes the graph on the first call.
     mediapipe::Status init();
 
+    /// Finishes the current run of the face-tracking graph. init() may be called again afterwards to process another video.
     mediapipe::Status stop();
 
+    /// Adapts how long process() waits for the landmarks of a frame to the frame rate of the next video
+    void setFps(double fps);
+
     /// Extract the eyes from the given inputFrame. Meant for online use (i.e. call this function for each frame of a stream of frames).
     /// @param inputFrame - a single frame of the input video
     /// @param framenr - number of the frame within the source video, used as a timecode
     /// @param rightEye - output parameter. will contain the rightEye after this method returns
     /// @param leftEye - output parameter. will contain the leftEye after this method returns
+    /// The eye crops may share memory with inputFrame, so they are only valid as long as inputFrame is not modified.
+    /// @returns the iris diameters of both eyes, or {-1, -1} if the frame could not be processed or an eye could not be cropped.
+    /// The eye crops don't show the eyes of inputFrame then and must not be used
     IrisDiameters process(const cv::Mat &inputFrame, size_t framenr, cv::Mat &rightEye, cv::Mat &leftEye);
 
+    /// First half of process(): hands the frame to the face-tracking graph without waiting for its landmarks.
+    /// Up to maxFramesInFlight frames may be submitted before their eyes are collected via collect().
+    /// @param inputFrame - a single frame of the input video
+    /// @param framenr - number of the frame within the source video, used as a timecode
+    bool submit(const cv::Mat &inputFrame, size_t framenr);
+
+    /// Second half of process(): waits for the landmarks of a previously submitted frame and crops the eyes from it.
+    /// Frames have to be collected in the order they were submitted.
+    /// @param inputFrame - the same frame that was passed to submit() for this framenr
+    /// @param framenr - number of the frame within the source video, used as a timecode
+    /// @param rightEye - output parameter. will contain the rightEye after this method returns
+    /// @param leftEye - output parameter. will contain the leftEye after this method returns
+    /// The eye crops may share memory with inputFrame, so they are only valid as long as inputFrame is not modified.
+    /// @returns the iris diameters of both eyes, or {-1, -1} if an eye could not be cropped.
+    /// The eye crops don't show the eyes of inputFrame then and must not be used
+    IrisDiameters collect(const cv::Mat &inputFrame, size_t framenr, cv::Mat &rightEye, cv::Mat &leftEye);
+
 private:
     mediapipe::Status initIrisTrackingGraph();
     mediapipe::Status pushFrameIntoGraph(const cv::Mat &inputFrame, size_t timecode);
     void processLandmarkPackets(const std::unique_ptr<mediapipe::OutputStreamPoller> &poller);
     EyesData extractIrisData(const mediapipe::Packet &landmarksPacket, const int &imageWidth, const int &imageHeight);
-    bool renderCroppedEyeFrame(const cv::Mat &camera_frame, const IrisData &irisData, cv::Mat &outputFrame);
+    /// @param scratchFrame - buffer for crops that reach beyond the frame's border, reused between calls
+    /// @param outputFrame - output parameter. refers to either camera_frame's or scratchFrame's memory afterwards
+    /// @returns false if the eye lies completely outside of the frame. outputFrame is then a dummy crop in scratchFrame
+    bool renderCroppedEyeFrame(const cv::Mat &camera_frame, const IrisData &irisData, cv::Mat &scratchFrame, cv::Mat &outputFrame);
 
     std::string m_IrisTrackingGraphConfigFile = "/hcmlabpupiltracking/deps/mediapipe-0.8.2/mediapipe/graphs/iris_tracking/iris_tracking_cpu.pbtxt";
     std::string m_kInputStream = "input_video";
@@ -58,17 +90,32 @@ private:
     std::unique_ptr<mediapipe::OutputStreamPoller> m_landmarksPoller;
     std::unique_ptr<std::thread> m_landmarksPollerThread;
     mediapipe::Packet m_lastLandmarksPacket;
-    mediapipe::Packet m_currentLandmarksPacket;
-    std::mutex m_currentLandmarksPacketMutex;
 
-    std::atomic<bool> m_currentLandmarksPacketIsEmpty;
-    std::atomic<size_t> m_currentLandmarksPacketTimestamp;
+    // landmark packets that arrived from the graph but were not collected yet, keyed by their timestamp (== frame number)
+    std::map<size_t, mediapipe::Packet> m_pendingLandmarksPackets;
+    // guards m_pendingLandmarksPackets and m_landmarksPollerFinished
+    std::mutex m_pendingLandmarksPacketsMutex;
+    // signalled by the poller thread whenever a new landmarks packet arrives or polling ends
+    std::condition_variable m_landmarksPacketArrived;
+    bool m_landmarksPollerFinished;
+
+    size_t m_maxFramesInFlight; // how many frames may be submitted into the graph before their landmarks are collected
 
     int m_eyeOutputVideoPadding = 40;
+    cv::Mat m_rightEyeScratch, m_leftEyeScratch; // border-replicated crops of eyes that are close to the frame's border
 
-    size_t m_frameWaitIntervalMs;
-    size_t m_maxWaitLoops;
+    std::chrono::milliseconds m_maxWaitTime; // how long process() waits for the landmarks of a frame before falling back to the last ones
 
     mediapipe::CalculatorGraph m_irisTrackingGraph;
+    bool m_irisTrackingGraphInitialized;
+
+    // pixel buffers of input ImageFrames the graph has released, to be refilled with the next frames.
+    // Shared with the deleters of the ImageFrames in flight, as the graph may release them from any of its threads
+    struct ImageFrameBufferPool
+    {
+        std::mutex mutex;
+        std::vector<cv::Mat> freeBuffers;
+    };
+    std::shared_ptr<ImageFrameBufferPool> m_imageFrameBufferPool;
 };
 #endif // HCMLAB_EYEEXTRACTOR_H
\ No newline at end of file
@@ -3,24 +3,61 @@
 #include <iostream>
 
 #include "util/hcmutils.h"
+#include "util/hcmstagetimer.h"
+#include "util/hcmtracerecorder.h"
 #include "outputwriters/hcmlabpupildatacsvwriter.h"
 #include "outputwriters/hcmlabpupildatassiwriter.h"
 
+/// placeholder result for frames whose pupils are not known (yet)
+static PupilTrackingDataFrame invalidTrackingDataFrame()
+{
+    return {PupilData({-1.0f, -1.0f, -1}, 1.0f), PupilData({-1.0f, -1.0f, -1}, 1.0f)};
+}
+
+/// the eye extractor reports frames whose eyes it could not crop with negative iris diameters
+static bool eyesCropped(const IrisDiameters &irisDiameters)
+{
+    return irisDiameters.left >= 0 && irisDiameters.right >= 0;
+}
 
 HCMLabFullFacePupilTracker::HCMLabFullFacePupilTracker(int inputWidth, int inputHeight, double inputfps, bool exportSSIStream,
                                        bool exportCSV, bool renderDebugVideo, std::string outputDirPath,
-                                       std::string outputBaseName)
-    : m_inputWidth(inputWidth),
-      m_inputHeight(inputHeight),
-      m_fps(inputfps),
-      m_exportSSIStream(exportSSIStream),
+                                       std::string outputBaseName, size_t pipelineDepth, bool parallelEyeDetection,
+                                       bool fastGradients)
+    : m_exportSSIStream(exportSSIStream),
       m_exportCSV(exportCSV),
       m_renderDebugVideo(renderDebugVideo),
-      m_debugVideoOutputPath(
-          outputDirPath + outputBaseName +
-              "_TRACKED_VIDEO.mp4"),
-      m_eyeExtractor(HCMLabEyeExtractor(inputfps))
+      m_pipelineDepth(pipelineDepth),
+      m_eyeExtractor(inputfps, pipelineDepth + 1),
+      m_detectorLeft(fastGradients),
+      m_detectorRight(fastGradients)
+{
+    if (parallelEyeDetection) {
+        m_eyeDetectionWorkers = std::make_unique<HCMWorkerPool>(2);
+        m_eyeDetectionTasks = {[this] { detectLeftPupil(); }, [this] { detectRightPupil(); }};
+    }
+
+    setupForVideo(inputWidth, inputHeight, inputfps, outputDirPath, outputBaseName);
+}
+
+void HCMLabFullFacePupilTracker::reset(int inputWidth, int inputHeight, double inputfps, std::string outputDirPath,
+                                       std::string outputBaseName)
+{
+    m_detectorLeft.reset();
+    m_detectorRight.reset();
+    m_eyeExtractor.setFps(inputfps);
+
+    setupForVideo(inputWidth, inputHeight, inputfps, outputDirPath, outputBaseName);
+}
+
+void HCMLabFullFacePupilTracker::setupForVideo(int inputWidth, int inputHeight, double inputfps, std::string outputDirPath,
+                                               std::string outputBaseName)
 {
+    m_inputWidth = inputWidth;
+    m_inputHeight = inputHeight;
+    m_fps = inputfps;
+    m_debugVideoOutputPath = outputDirPath + outputBaseName + "_TRACKED_VIDEO.mp4";
+
     int debugOutputWidth = m_debugPadding
                             + inputWidth / m_debugSourceVideoScaleDivider
                             + m_debugPadding
@@ -37,12 +74,16 @@ HCMLabFullFacePupilTracker::HCMLabFullFacePupilTracker(int inputWidth, int input
 
     m_debugOutputMat = cv::Mat::zeros(m_debugOutputSize, CV_8UC3);
 
+    m_trackingData.clear();
+
+    m_outputStreamer.clearWriters();
+
     if (m_exportCSV) {
-        m_outputWriters.push_back(std::make_unique<HCMLabPupilDataCSVWriter>(outputDirPath, outputBaseName));
+        m_outputStreamer.addWriter(std::make_unique<HCMLabPupilDataCSVWriter>(outputDirPath, outputBaseName));
     }
 
     if (m_exportSSIStream) {
-        m_outputWriters.push_back(std::make_unique<HCMLabPupilDataSSIWriter>(outputDirPath, outputBaseName, inputfps));
+        m_outputStreamer.addWriter(std::make_unique<HCMLabPupilDataSSIWriter>(outputDirPath, outputBaseName, inputfps));
     }
 }
 
@@ -65,26 +106,99 @@ bool HCMLabFullFacePupilTracker::init()
         hcmutils::logInfo("Initialized Debug Videowriter");
     }
 
+    m_outputStreamer.begin();
+
     return true;
 }
 
 PupilTrackingDataFrame HCMLabFullFacePupilTracker::process(const cv::Mat &inputFrame,
                                                    size_t frameNr)
 {
-    IrisDiameters irisDiameters = m_eyeExtractor.process(inputFrame, frameNr, m_rightEyeMat, m_leftEyeMat);
+    if (m_pipelineDepth == 0) {
+        HCMTraceScope traceScope("track_frame", static_cast<int64_t>(frameNr));
+        IrisDiameters irisDiameters = m_eyeExtractor.process(inputFrame, frameNr, m_rightEyeMat, m_leftEyeMat);
+        if (!eyesCropped(irisDiameters)) {
+            return recordInvalidFrame();
+        }
+        return detectPupils(inputFrame, irisDiameters);
+    }
+
+    // the caller may reuse inputFrame's memory for the next frame, so keep our own copy while the frame is in flight
+    InFlightFrame inFlightFrame;
+    if (!m_recycledFrameBuffers.empty()) {
+        inFlightFrame.frame = std::move(m_recycledFrameBuffers.back());
+        m_recycledFrameBuffers.pop_back();
+    }
+    inputFrame.copyTo(inFlightFrame.frame);
+    inFlightFrame.frameNr = frameNr;
+    inFlightFrame.submitted = m_eyeExtractor.submit(inFlightFrame.frame, frameNr);
+
+    if (!inFlightFrame.submitted) {
+        // the frame still queues up behind the frames in flight, so that its invalid row ends up in the right place of the output
+        m_recycledFrameBuffers.push_back(std::move(inFlightFrame.frame));
+        inFlightFrame.frame = cv::Mat();
+    }
+    m_inFlightFrames.push_back(std::move(inFlightFrame));
+
+    if (m_inFlightFrames.size() <= m_pipelineDepth) {
+        // pipeline is still filling up
+        return invalidTrackingDataFrame();
+    }
+
+    return processOldestInFlightFrame();
+}
+
+PupilTrackingDataFrame HCMLabFullFacePupilTracker::processOldestInFlightFrame()
+{
+    InFlightFrame &oldest = m_inFlightFrames.front();
+    HCMTraceScope traceScope("track_frame", static_cast<int64_t>(oldest.frameNr));
 
-    RawPupilData leftPupilDataRaw, rightPupilDataRaw;
+    if (!oldest.submitted) {
+        m_inFlightFrames.pop_front();
+        return recordInvalidFrame();
+    }
+
+    IrisDiameters irisDiameters = m_eyeExtractor.collect(oldest.frame, oldest.frameNr, m_rightEyeMat, m_leftEyeMat);
+    PupilTrackingDataFrame trackingData = eyesCropped(irisDiameters) ? detectPupils(oldest.frame, irisDiameters) : recordInvalidFrame();
+
+    m_recycledFrameBuffers.push_back(std::move(oldest.frame));
+    m_inFlightFrames.pop_front();
+
+    return trackingData;
+}
+
+void HCMLabFullFacePupilTracker::detectLeftPupil()
+{
+    HCMTraceScope traceScope("detect_left_pupil");
     if (m_renderDebugVideo) {
-        leftPupilDataRaw = m_detectorLeft.process(m_leftEyeMat, m_leftDebugMat);
-        rightPupilDataRaw = m_detectorRight.process(m_rightEyeMat, m_rightDebugMat);
+        m_leftPupilDataRaw = m_detectorLeft.process(m_leftEyeMat, m_leftDebugMat);
     } else {
-        leftPupilDataRaw = m_detectorLeft.process(m_leftEyeMat);
-        rightPupilDataRaw = m_detectorRight.process(m_rightEyeMat);
+        m_leftPupilDataRaw = m_detectorLeft.process(m_leftEyeMat);
     }
+}
 
-    PupilTrackingDataFrame trackingData = {PupilData(leftPupilDataRaw, irisDiameters.left), PupilData(rightPupilDataRaw, irisDiameters.right)};
+void HCMLabFullFacePupilTracker::detectRightPupil()
+{
+    HCMTraceScope traceScope("detect_right_pupil");
+    if (m_renderDebugVideo) {
+        m_rightPupilDataRaw = m_detectorRight.process(m_rightEyeMat, m_rightDebugMat);
+    } else {
+        m_rightPupilDataRaw = m_detectorRight.process(m_rightEyeMat);
+    }
+}
 
-    m_trackingData.push_back(trackingData);
+PupilTrackingDataFrame HCMLabFullFacePupilTracker::detectPupils(const cv::Mat &inputFrame, const IrisDiameters &irisDiameters)
+{
+    if (m_eyeDetectionWorkers) {
+        // the two detectors share no state, so both eyes can be processed at the same time
+        m_eyeDetectionWorkers->runMultiThreaded(m_eyeDetectionTasks);
+    } else {
+        detectLeftPupil();
+        detectRightPupil();
+    }
+
+    PupilTrackingDataFrame trackingData = {PupilData(m_leftPupilDataRaw, irisDiameters.left), PupilData(m_rightPupilDataRaw, irisDiameters.right)};
+    appendTrackingData(trackingData);
 
     if (m_renderDebugVideo) {
         writeDebugFrame(inputFrame);
@@ -93,10 +207,32 @@ PupilTrackingDataFrame HCMLabFullFacePupilTracker::process(const cv::Mat &inputF
     return trackingData;
 }
 
+PupilTrackingDataFrame HCMLabFullFacePupilTracker::recordInvalidFrame()
+{
+    PupilTrackingDataFrame trackingData = invalidTrackingDataFrame();
+    appendTrackingData(trackingData);
+    return trackingData;
+}
+
+void HCMLabFullFacePupilTracker::appendTrackingData(const PupilTrackingDataFrame &trackingData)
+{
+    if (m_outputStreamer.hasWriters()) {
+        HCMStageTimer timer(HCMStage::OUTPUT_WRITING);
+        m_outputStreamer.append(trackingData);
+    } else {
+        m_trackingData.push_back(trackingData);
+    }
+}
+
 bool HCMLabFullFacePupilTracker::stop()
 {
     bool retVal = true;
 
+    // frames still in the graph have to be finished before it is closed
+    while (!m_inFlightFrames.empty()) {
+        processOldestInFlightFrame();
+    }
+
     if (m_debugVideoWriter.isOpened()) {
         m_debugVideoWriter.release();
     }
@@ -106,16 +242,14 @@ bool HCMLabFullFacePupilTracker::stop()
         retVal = false;
     }
 
-    writeOutTrackingData();
+    m_outputStreamer.finish();
 
     return retVal;
 }
 
-void HCMLabFullFacePupilTracker::writeOutTrackingData()
+const std::vector<PupilTrackingDataFrame> &HCMLabFullFacePupilTracker::getTrackingData() const
 {
-    for (const auto &writer : m_outputWriters) {
-        writer->write(m_trackingData);
-    }
+    return m_trackingData;
 }
 
 /***
@@ -137,6 +271,8 @@ void HCMLabFullFacePupilTracker::writeOutTrackingData()
  */
 void HCMLabFullFacePupilTracker::writeDebugFrame(const cv::Mat &inputFrame)
 {
+    HCMStageTimer timer(HCMStage::DEBUG_RENDERING);
+
     m_debugOutputMat = cv::Scalar(0, 0, 0);
 
     int sourceVideoScaledWidth = inputFrame.cols / m_debugSourceVideoScaleDivider;
@@ -3,13 +3,16 @@
 
 #include <string>
 #include <vector>
+#include <deque>
 #include <memory>
+#include <functional>
 
 #include "util/hcmdatatypes.h"
+#include "util/hcmworkerpool.h"
 #include "hcmlabpupiltracker.h"
 #include "hcmlabeyeextractor.h"
 #include "hcmlabpupildetector.h"
-#include "outputwriters/hcmlabpupildataoutputwriter.h"
+#include "outputwriters/hcmlabpupildatastreamer.h"
 
 #include "mediapipe/framework/calculator_framework.h"
 #include "mediapipe/framework/port/opencv_highgui_inc.h"
@@ -18,12 +21,24 @@
 #include "mediapipe/framework/port/status.h"
 
 
+/**
+ * Tracks both pupils in videos of a full face. The eyes are located by mediapipe's iris tracking graph
+ * and then handed to one HCMLabPupilDetector per eye.
+ *
+ * With a pipelineDepth > 0 the tracker keeps up to pipelineDepth frames in the mediapipe graph while
+ * the pupil detectors work on an earlier frame, so face tracking and pupil detection run concurrently.
+ * In that mode process() returns the tracking data of the frame that was submitted pipelineDepth calls earlier
+ * (or invalid data while the pipeline is still filling up). stop() processes all frames that are still in flight.
+ *
+ * With parallelEyeDetection the left and right eye are handed to their detectors concurrently on a persistent pool of two workers.
+ */
 class HCMLabFullFacePupilTracker : public I_HCMLabPupilTracker
 {
 public:
     HCMLabFullFacePupilTracker(int inputWidth, int inputHeight, double inputfps, bool exportSSIStream,
                        bool exportCSV, bool renderDebugVideo, std::string outputDirPath,
-                       std::string outputBaseName);
+                       std::string outputBaseName, size_t pipelineDepth = 0, bool parallelEyeDetection = false,
+                       bool fastGradients = false);
 
     ~HCMLabFullFacePupilTracker()
     {};
@@ -37,21 +52,61 @@ public:
 
     bool stop();
 
+    /// Only collected if the tracker exports neither CSV nor SSI, otherwise the data is streamed into the output files right away
+    const std::vector<PupilTrackingDataFrame> &getTrackingData() const;
+
+    void reset(int inputWidth, int inputHeight, double inputfps, std::string outputDirPath,
+               std::string outputBaseName);
+
 private:
-    void writeDebugFrame(const cv::Mat &inputFrame);
+    /// (re-)creates everything that depends on the video that is processed next
+    void setupForVideo(int inputWidth, int inputHeight, double inputfps, std::string outputDirPath,
+                       std::string outputBaseName);
+
+    /// a frame that was pushed into the mediapipe graph, but whose pupils were not detected yet
+    struct InFlightFrame
+    {
+        cv::Mat frame;
+        size_t frameNr;
+        bool submitted; // false if the graph did not accept the frame. It only waits for its turn to record an invalid row then
+    };
+
+    /// waits for the eyes of the oldest in-flight frame and runs the pupil detectors on them
+    PupilTrackingDataFrame processOldestInFlightFrame();
 
-    void writeOutTrackingData();
+    void detectLeftPupil();
+    void detectRightPupil();
+
+    /// runs the pupil detectors on the current eye crops and hands the result to the output writers (or stores it in m_trackingData)
+    PupilTrackingDataFrame detectPupils(const cv::Mat &inputFrame, const IrisDiameters &irisDiameters);
+
+    /// records invalid data for a frame whose eyes could not be cropped, so that every frame keeps its row in the output.
+    /// The pupil detectors don't run and the frame is left out of the debug video, as there are no eye crops to show
+    PupilTrackingDataFrame recordInvalidFrame();
+
+    /// hands the tracking data of a frame to the output writers (or stores it in m_trackingData)
+    void appendTrackingData(const PupilTrackingDataFrame &trackingData);
+
+    void writeDebugFrame(const cv::Mat &inputFrame);
 
 private:
     HCMLabEyeExtractor m_eyeExtractor;
     HCMLabPupilDetector m_detectorLeft;
     HCMLabPupilDetector m_detectorRight;
 
+    std::unique_ptr<HCMWorkerPool> m_eyeDetectionWorkers; // only set if both eyes should be processed concurrently
+    std::vector<std::function<void()>> m_eyeDetectionTasks;
+    RawPupilData m_leftPupilDataRaw, m_rightPupilDataRaw;
+
     cv::Mat m_leftEyeMat, m_rightEyeMat;
 
+    size_t m_pipelineDepth;
+    std::deque<InFlightFrame> m_inFlightFrames;
+    std::vector<cv::Mat> m_recycledFrameBuffers; // buffers of already processed in-flight frames, reused to avoid per-frame allocations
+
     std::vector<PupilTrackingDataFrame> m_trackingData;
 
-    std::vector<std::unique_ptr<HCMLabPupilDataOutputWriter_I>> m_outputWriters;
+    HCMLabPupilDataStreamer m_outputStreamer;
 
     int m_inputWidth, m_inputHeight;
     double m_fps;
@@ -1,30 +1,56 @@
 #include "hcmlabpupildetector.h"
 
 #include "util/hcmutils.h"
+#include "util/hcmstagetimer.h"
 
 #include <sstream>
+#include <algorithm>
+#include <cmath>
 
-HCMLabPupilDetector::HCMLabPupilDetector()
+HCMLabPupilDetector::HCMLabPupilDetector(bool fastGradients)
     : m_optimizeImage(true),
+      m_fastGradients(fastGradients),
       m_currentTimestamp(0)
 {
+    reset();
 }
 
 HCMLabPupilDetector::~HCMLabPupilDetector()
 {
 }
 
-RawPupilData HCMLabPupilDetector::process(const cv::Mat &inputFrame)
+void HCMLabPupilDetector::reset()
 {
-    cv::cvtColor(inputFrame, m_camera_frame_GRAY, cv::COLOR_BGR2GRAY);
+    m_pupil.clear();
+    m_pure = PuRe();
+    m_purest = PuReST();
+    m_pure.setGradientMode(m_fastGradients ? PuRe::FAST_GRADIENT : PuRe::REFERENCE_GRADIENT);
+    m_purest.setGradientMode(m_fastGradients ? PuRe::FAST_GRADIENT : PuRe::REFERENCE_GRADIENT);
+    m_currentTimestamp = 0;
+    m_lastFrameContrast = 0;
+    m_pupilInspectionKernelSize = m_DEFAULT_PUPIL_INSPECTION_KERNEL_SIZE;
+}
 
+RawPupilData HCMLabPupilDetector::process(const cv::Mat &inputFrame)
+{
     if (m_optimizeImage)
     {
         optimizeImage(inputFrame, m_camera_frame_GRAY);
     }
+    else
+    {
+        cv::cvtColor(inputFrame, m_camera_frame_GRAY, cv::COLOR_BGR2GRAY);
+    }
 
     cv::Rect roi(0, 0, m_camera_frame_GRAY.cols, m_camera_frame_GRAY.rows);
-    m_purest.track(m_currentTimestamp, m_camera_frame_GRAY, roi, m_pupil, m_pure);
+    {
+        HCMStageTimer timer(HCMStage::PUPIL_TRACKING);
+        m_purest.track(m_currentTimestamp, m_camera_frame_GRAY, roi, m_pupil, m_pure);
+        if (m_purest.lastTrackWasDetection())
+        {
+            timer.setStage(HCMStage::PUPIL_DETECTION);
+        }
+    }
 
     m_currentTimestamp++;
 
@@ -36,6 +62,7 @@ RawPupilData HCMLabPupilDetector::process(const cv::Mat &inputFrame, cv::Mat &de
     auto trackingData = process(inputFrame);
 
     //debug drawing
+    HCMStageTimer timer(HCMStage::DEBUG_RENDERING);
     cv::cvtColor(m_camera_frame_GRAY, debugOutputFrame, cv::COLOR_GRAY2RGB);
     if (m_pupil.diameter() > 0 && m_pupil.center.x >= 0 && m_pupil.center.y >= 0) {
         //only draw if the pupil was actually detected properly
@@ -49,26 +76,71 @@ RawPupilData HCMLabPupilDetector::process(const cv::Mat &inputFrame, cv::Mat &de
     return trackingData;
 }
 
+/// Converts the BGR image to grayscale (with the same fixed point coefficients as cv::cvtColor) and counts its gray values.
+/// Works on non-continuous images (e.g. ROI views) as well.
+static void convertToGrayWithHistogram(const cv::Mat &img_in_BGR, cv::Mat &img_out_GRAY, int histogram[256])
+{
+    CV_Assert(img_in_BGR.type() == CV_8UC3);
+
+    // Y = 0.114 * B + 0.587 * G + 0.299 * R in 14 bit fixed point, like cv::COLOR_BGR2GRAY
+    const int grayShift = 14;
+    const int blueWeight = 1868, greenWeight = 9617, redWeight = 4899;
+    const int rounding = 1 << (grayShift - 1);
+
+    img_out_GRAY.create(img_in_BGR.size(), CV_8UC1);
+    std::fill(histogram, histogram + 256, 0);
+
+    for (int row = 0; row < img_in_BGR.rows; row++)
+    {
+        const uchar *bgr = img_in_BGR.ptr<uchar>(row);
+        uchar *gray = img_out_GRAY.ptr<uchar>(row);
+
+        for (int col = 0; col < img_in_BGR.cols; col++, bgr += 3)
+        {
+            uchar value = static_cast<uchar>((bgr[0] * blueWeight + bgr[1] * greenWeight + bgr[2] * redWeight + rounding) >> grayShift);
+            gray[col] = value;
+            histogram[value]++;
+        }
+    }
+}
+
+/// Brightness and contrast enhancement only depend on the gray value of a pixel, so both are combined into one lookup table.
+/// The first pass over the image converts it to gray and collects the statistics, the second one applies the table.
 void HCMLabPupilDetector::optimizeImage(const cv::Mat &img_in_BGR, cv::Mat &img_out_GRAY)
 {
-    cv::Mat input_GRAY;
-    cv::cvtColor(img_in_BGR, input_GRAY, cv::COLOR_BGR2GRAY);
+    HCMStageTimer timer(HCMStage::OPTIMIZE_IMAGE);
+
+    int histogram[256];
+    convertToGrayWithHistogram(img_in_BGR, m_unoptimized_GRAY, histogram);
+
+    m_enhancementLut.create(1, 256, CV_8UC1);
+    uchar *lut = m_enhancementLut.ptr<uchar>();
 
-    enhanceBrightness(input_GRAY);
-    enhanceContrast(input_GRAY);
+    enhanceBrightness(histogram, static_cast<int>(m_unoptimized_GRAY.total()), lut);
+    enhanceContrast(m_unoptimized_GRAY, lut);
 
-    input_GRAY.copyTo(img_out_GRAY);
+    cv::LUT(m_unoptimized_GRAY, m_enhancementLut, img_out_GRAY);
 }
 
 ///increases the brightness of a grayscale image inversely to mean and stddev
 ///(i.e. the lower the mean and stddev, the more the brightness is increased)
-void HCMLabPupilDetector::enhanceBrightness(cv::Mat &input_GRAY)
+///@param histogram - occurrences of each gray value in the image
+///@param lut - output parameter. maps each gray value to its brightened value
+void HCMLabPupilDetector::enhanceBrightness(const int histogram[256], int nrOfPixels, uchar lut[256])
 {
-    cv::Mat mean_mat;
-    cv::Mat stddev_mat;
-    cv::meanStdDev(input_GRAY, mean_mat, stddev_mat);
-    int mean = static_cast<int>(std::round(mean_mat.at<double>(0)));
-    int stddev = static_cast<int>(std::round(stddev_mat.at<double>(0)));
+    // same as cv::meanStdDev, just computed from the histogram
+    double sum = 0.0;
+    double squaredSum = 0.0;
+    for (int value = 0; value < 256; value++)
+    {
+        sum += static_cast<double>(value) * histogram[value];
+        squaredSum += static_cast<double>(value) * value * histogram[value];
+    }
+    double meanValue = nrOfPixels > 0 ? sum / nrOfPixels : 0.0;
+    double variance = nrOfPixels > 0 ? std::max(squaredSum / nrOfPixels - meanValue * meanValue, 0.0) : 0.0;
+
+    int mean = static_cast<int>(std::round(meanValue));
+    int stddev = static_cast<int>(std::round(std::sqrt(variance)));
 
     m_debugStringStr << "M: " << mean << ", S: " << stddev;
 
@@ -116,15 +188,22 @@ void HCMLabPupilDetector::enhanceBrightness(cv::Mat &input_GRAY)
     }
 
     m_debugStringStr << ", bf: " << brightnessFactor;
-    input_GRAY *= brightnessFactor;
+
+    // equivalent to input_GRAY *= brightnessFactor
+    for (int value = 0; value < 256; value++)
+    {
+        lut[value] = cv::saturate_cast<uchar>(value * brightnessFactor);
+    }
 }
 
 ///enhances the contrast of a grayscale image depending on how much contrast
 ///already exists between pupil and iris.
-void HCMLabPupilDetector::enhanceContrast(cv::Mat &input_GRAY)
+///@param img_in_GRAY - the image before brightness enhancement
+///@param lut - maps each gray value to its brightened value. The contrast enhancement is added on top
+void HCMLabPupilDetector::enhanceContrast(const cv::Mat &img_in_GRAY, uchar lut[256])
 {
-    auto pupilBrightness = detectAveragePupilBrightness(input_GRAY);
-    auto irisBrightness = detectAverageIrisBrightness(input_GRAY);
+    auto pupilBrightness = detectAveragePupilBrightness(img_in_GRAY, lut);
+    auto irisBrightness = detectAverageIrisBrightness(img_in_GRAY, lut);
     auto innerEyeContrast = irisBrightness - pupilBrightness;
 
     bool adjustContrast = true;
@@ -170,24 +249,44 @@ void HCMLabPupilDetector::enhanceContrast(cv::Mat &input_GRAY)
     if (adjustContrast)
     {
         m_debugStringStr << ", IEC: " << innerEyeContrast << ", c: " << contrast;
-        adjustImageContrast(input_GRAY, contrast);
+        adjustImageContrast(lut, contrast);
         m_lastFrameContrast = contrast;
     }
 }
 
-/// modifies the contrast of an image
+/// modifies the contrast of all values of a lookup table
 /// -127 < contrast < 127 is expected!
-void HCMLabPupilDetector::adjustImageContrast(cv::Mat &inputImageGRAY, const int &contrast)
+void HCMLabPupilDetector::adjustImageContrast(uchar lut[256], const int &contrast)
 {
     double f = (131.0 * (static_cast<double>(contrast) + 127.0)) / (127.0 * (131.0 - static_cast<double>(contrast)));
-    auto alpha_c = f;
-    auto gamma_c = 127.0 * (1.0 - f);
-    cv::addWeighted(inputImageGRAY, alpha_c, inputImageGRAY, 0, gamma_c, inputImageGRAY);
+    // cv::addWeighted computes in float precision for 8 bit images
+    auto alpha_c = static_cast<float>(f);
+    auto gamma_c = static_cast<float>(127.0 * (1.0 - f));
+    for (int value = 0; value < 256; value++)
+    {
+        lut[value] = cv::saturate_cast<uchar>(lut[value] * alpha_c + gamma_c);
+    }
+}
+
+/// @returns the sum of the brightened values (according to lut) of all pixels within the roi
+static long long sumOfBrightenedValues(const cv::Mat &img_in_GRAY, const cv::Rect &roi, const uchar lut[256])
+{
+    long long sum = 0;
+    for (int row = roi.y; row < roi.y + roi.height; row++)
+    {
+        const uchar *gray = img_in_GRAY.ptr<uchar>(row);
+        for (int col = roi.x; col < roi.x + roi.width; col++)
+        {
+            sum += lut[gray[col]];
+        }
+    }
+    return sum;
 }
 
 /// determines the pupil brightness by averaging over a 20x20 square in the center of the input image.
 /// This works because the HCMLabEyeExtractor crops the eyes in a way, that the pupil is in the center of the image most of the time
-int HCMLabPupilDetector::detectAveragePupilBrightness(const cv::Mat &img_in_GRAY)
+/// @param lut - the brightness of a pixel is its value mapped through this table
+int HCMLabPupilDetector::detectAveragePupilBrightness(const cv::Mat &img_in_GRAY, const uchar lut[256])
 {
     int centerRoiX = (img_in_GRAY.cols - m_pupilInspectionKernelSize) / 2;
     int centerRoiY = (img_in_GRAY.rows - m_pupilInspectionKernelSize) / 2;
@@ -202,28 +301,29 @@ int HCMLabPupilDetector::detectAveragePupilBrightness(const cv::Mat &img_in_GRAY
                 safeHeight
     );
 
-    cv::Mat pupilMat = img_in_GRAY(pupilRoi);
+    if (pupilRoi.area() == 0)
+    {
+        return 0;
+    }
 
-    const auto pupilBrightness = cv::mean(pupilMat);
-    return pupilBrightness[0];
+    return static_cast<int>(sumOfBrightenedValues(img_in_GRAY, pupilRoi, lut) / static_cast<double>(pupilRoi.area()));
 }
 
 /// determines the average brightness of the iris, without the pupil
 /// determines this by averaging over 5 squares distributed as neighbors around a 20x20 square at the center of the image
 /// This works because the HCMLabEyeExtractor crops the eyes in a way, that the pupil is in the center of the image most of the time
-int HCMLabPupilDetector::detectAverageIrisBrightness(cv::Mat &img_in_GRAY)
+/// @param lut - the brightness of a pixel is its value mapped through this table
+int HCMLabPupilDetector::detectAverageIrisBrightness(const cv::Mat &img_in_GRAY, const uchar lut[256])
 {
     if (m_pupilInspectionKernelSize > 0.3 * img_in_GRAY.cols || m_pupilInspectionKernelSize > 0.3 * img_in_GRAY.rows) {
         m_pupilInspectionKernelSize = std::min(0.3 * img_in_GRAY.cols, 0.3 * img_in_GRAY.rows);
     }
 
-    //collect 8 kernels into one row and then average over that row of kernels
-    cv::Mat aufsammelMat = cv::Mat::zeros(m_pupilInspectionKernelSize, 5 * m_pupilInspectionKernelSize, CV_8UC1);
-
     int centerX = img_in_GRAY.cols / 2;
     int centerY = img_in_GRAY.rows / 2;
 
-    int aufsammelPos = 0;
+    //average over the 5 kernels as if they were collected into one row
+    long long irisSum = 0;
     for (int row = 0; row < 2; row++)
     {
         for (int col = -1; col < 2; col++)
@@ -240,25 +340,21 @@ int HCMLabPupilDetector::detectAverageIrisBrightness(cv::Mat &img_in_GRAY)
                 std::min(m_pupilInspectionKernelSize, img_in_GRAY.rows)
             );
 
-            cv::Mat roiMat = img_in_GRAY(kernelRoi);
-
-            // cv::rectangle(img_in_GRAY, kernelRoi, cv::Scalar(255));
-
-            cv::Rect aufsammelRoi(aufsammelPos, 0, roiMat.cols, roiMat.rows);
-            cv::Mat aufsammelTargetMat = aufsammelMat(aufsammelRoi);
-
-            roiMat.copyTo(aufsammelTargetMat);
-
-            aufsammelPos += m_pupilInspectionKernelSize;
+            irisSum += sumOfBrightenedValues(img_in_GRAY, kernelRoi, lut);
         }
     }
 
-    const auto irisBrightness = cv::mean(aufsammelMat);
+    int irisArea = 5 * m_pupilInspectionKernelSize * m_pupilInspectionKernelSize;
 
     //reset kernel size for next image
     m_pupilInspectionKernelSize = m_DEFAULT_PUPIL_INSPECTION_KERNEL_SIZE;
 
-    return irisBrightness[0];
+    if (irisArea == 0)
+    {
+        return 0;
+    }
+
+    return static_cast<int>(irisSum / static_cast<double>(irisArea));
 }
 
 void HCMLabPupilDetector::drawPupilOutline(cv::Mat &img_RGB, cv::Point center, double radius)
@@ -18,21 +18,25 @@
 class HCMLabPupilDetector
 {
 public:
-    HCMLabPupilDetector();
+    /// @param fastGradients - use PuRe's approximate integer gradients instead of the reference float ones
+    HCMLabPupilDetector(bool fastGradients = false);
     ~HCMLabPupilDetector();
 
     RawPupilData process(const cv::Mat &inputFrame, cv::Mat &debugOutputFrame);
     RawPupilData process(const cv::Mat &inputFrame);
 
+    /// forgets all tracking state, so the next frame is treated like the first frame of a new video
+    void reset();
+
 private:
     void optimizeImage(const cv::Mat &img_in_BGR, cv::Mat &img_out_GRAY);
-    void adjustImageContrast(cv::Mat &inputImageGRAY, const int &contrast);
+    void adjustImageContrast(uchar lut[256], const int &contrast);
 
-    int detectAveragePupilBrightness(const cv::Mat &img_in_GRAY);
-    int detectAverageIrisBrightness(cv::Mat &img_in_GRAY);
+    int detectAveragePupilBrightness(const cv::Mat &img_in_GRAY, const uchar lut[256]);
+    int detectAverageIrisBrightness(const cv::Mat &img_in_GRAY, const uchar lut[256]);
 
-    void enhanceBrightness(cv::Mat &input_GRAY);
-    void enhanceContrast(cv::Mat &input_GRAY);
+    void enhanceBrightness(const int histogram[256], int nrOfPixels, uchar lut[256]);
+    void enhanceContrast(const cv::Mat &img_in_GRAY, uchar lut[256]);
 
     void drawPupilOutline(cv::Mat &img_RGB, cv::Point center, double radius);
     void putPupilInfoText(cv::Mat &img_RGB, int diameter, float confidence);
@@ -44,8 +48,11 @@ private:
     Timestamp m_currentTimestamp;
 
     cv::Mat m_camera_frame_GRAY;
+    cv::Mat m_unoptimized_GRAY; // grayscale input before brightness and contrast enhancement
+    cv::Mat m_enhancementLut;   // combined brightness and contrast enhancement of the current frame
 
     bool m_optimizeImage;
+    bool m_fastGradients;
     std::ostringstream m_debugStringStr;
     int m_DEFAULT_PUPIL_INSPECTION_KERNEL_SIZE = 30;
     int m_pupilInspectionKernelSize = m_DEFAULT_PUPIL_INSPECTION_KERNEL_SIZE;
@@ -1,6 +1,9 @@
 #ifndef HCMLAB_PUPILTRACKER_H
 #define HCMLAB_PUPILTRACKER_H
 
+#include <vector>
+#include <string>
+
 #include "util/hcmdatatypes.h"
 
 #include "mediapipe/framework/port/opencv_highgui_inc.h"
@@ -17,11 +20,16 @@
  *      tracker.process(frame);
  * 
  * tracker.stop(); //important for shutting down any resources the tracker has opened
+ *
+ * To process another video with the same tracker, call reset() after stop() and start over with init().
+ * Expensive resources (e.g. the mediapipe graph) are kept alive in between.
  *  
 */
 class I_HCMLabPupilTracker
 {
 public:
+    virtual ~I_HCMLabPupilTracker() {}
+
     virtual bool init() = 0;
 
     /// Tracks human pupils and their size in the given inputFrame. Meant for online use (i.e. call this function for each frame of a stream of frames).
@@ -30,6 +38,14 @@ public:
     virtual PupilTrackingDataFrame process(const cv::Mat &inputFrame, size_t frameNr) = 0;
 
     virtual bool stop() = 0;
+
+    /// @returns the tracking data of all frames that were processed since the last init(), if the tracker exports neither CSV nor SSI.
+    /// A tracker that exports its data streams it into the output files right away and does not keep it, it returns an empty vector
+    virtual const std::vector<PupilTrackingDataFrame> &getTrackingData() const = 0;
+
+    /// Prepares a stopped tracker for the next video. Writes its outputs to outputDirPath and names them after outputBaseName.
+    virtual void reset(int inputWidth, int inputHeight, double inputfps, std::string outputDirPath,
+                       std::string outputBaseName) = 0;
 };
 
 #endif // HCMLAB_PUPILTRACKER_H
\ No newline at end of file
@@ -3,22 +3,19 @@
 #include <iostream>
 
 #include "util/hcmutils.h"
+#include "util/hcmstagetimer.h"
+#include "util/hcmtracerecorder.h"
 #include "outputwriters/hcmlabpupildatacsvwriter.h"
 #include "outputwriters/hcmlabpupildatassiwriter.h"
 
 
 HCMLabSingleEyePupilTracker::HCMLabSingleEyePupilTracker(int inputWidth, int inputHeight, double inputfps, bool exportSSIStream,
                                        bool exportCSV, bool renderDebugVideo, std::string outputDirPath,
-                                       std::string outputBaseName)
-    : m_inputWidth(inputWidth),
-      m_inputHeight(inputHeight),
-      m_fps(inputfps),
-      m_exportSSIStream(exportSSIStream),
+                                       std::string outputBaseName, bool fastGradients)
+    : m_exportSSIStream(exportSSIStream),
       m_exportCSV(exportCSV),
       m_renderDebugVideo(renderDebugVideo),
-      m_debugVideoOutputPath(
-          outputDirPath + outputBaseName +
-              "_TRACKED_VIDEO.mp4")
+      m_pupilDetector(fastGradients)
 {
     int debugOutputWidth = m_debugPadding
                             + m_debugVideoEyeSize
@@ -34,16 +31,39 @@ HCMLabSingleEyePupilTracker::HCMLabSingleEyePupilTracker(int inputWidth, int inp
 
     m_debugOutputMat = cv::Mat::zeros(m_debugOutputSize, CV_8UC3);
 
+    setupForVideo(inputWidth, inputHeight, inputfps, outputDirPath, outputBaseName);
+}
+
+void HCMLabSingleEyePupilTracker::reset(int inputWidth, int inputHeight, double inputfps, std::string outputDirPath,
+                                        std::string outputBaseName)
+{
+    m_pupilDetector.reset();
+
+    setupForVideo(inputWidth, inputHeight, inputfps, outputDirPath, outputBaseName);
+}
+
+void HCMLabSingleEyePupilTracker::setupForVideo(int inputWidth, int inputHeight, double inputfps, std::string outputDirPath,
+                                                std::string outputBaseName)
+{
+    m_inputWidth = inputWidth;
+    m_inputHeight = inputHeight;
+    m_fps = inputfps;
+    m_debugVideoOutputPath = outputDirPath + outputBaseName + "_TRACKED_VIDEO.mp4";
+
     std::cout << "Width: " << m_inputWidth << ", Height: " << m_inputHeight << ", fps: " << m_fps << ", outputpath: " << m_debugVideoOutputPath << "\n";
     std::cout << "Debug Render: " << (m_renderDebugVideo ? "true" : "false") << "\n";
     std::cout << "Debug output mat: " << m_debugOutputMat.cols << ", " << m_debugOutputMat.rows << "\n";
 
+    m_trackingData.clear();
+
+    m_outputStreamer.clearWriters();
+
     if (m_exportCSV) {
-        m_outputWriters.push_back(std::make_unique<HCMLabPupilDataCSVWriter>(outputDirPath, outputBaseName));
+        m_outputStreamer.addWriter(std::make_unique<HCMLabPupilDataCSVWriter>(outputDirPath, outputBaseName));
     }
 
     if (m_exportSSIStream) {
-        m_outputWriters.push_back(std::make_unique<HCMLabPupilDataSSIWriter>(outputDirPath, outputBaseName, inputfps));
+        m_outputStreamer.addWriter(std::make_unique<HCMLabPupilDataSSIWriter>(outputDirPath, outputBaseName, inputfps));
     }
 }
 
@@ -60,12 +80,16 @@ bool HCMLabSingleEyePupilTracker::init()
         hcmutils::logInfo("Initialized Debug Videowriter");
     }
 
+    m_outputStreamer.begin();
+
     return true;
 }
 
 PupilTrackingDataFrame HCMLabSingleEyePupilTracker::process(const cv::Mat &inputFrame,
                                                    size_t frameNr)
 {
+    HCMTraceScope traceScope("track_frame", static_cast<int64_t>(frameNr));
+
     IrisDiameters irisDiameters = {1.0f, 1.0f}; //dummy diameters because footage from an eye-tracker is always constant distance from the eye
 
     RawPupilData pupilDataRaw;
@@ -78,7 +102,12 @@ PupilTrackingDataFrame HCMLabSingleEyePupilTracker::process(const cv::Mat &input
     //duplicate tracking data to adhere to data format that was designed for tracking two eyes!
     PupilTrackingDataFrame trackingData = {PupilData(pupilDataRaw, irisDiameters.left), PupilData(pupilDataRaw, irisDiameters.left)};
 
-    m_trackingData.push_back(trackingData);
+    if (m_outputStreamer.hasWriters()) {
+        HCMStageTimer timer(HCMStage::OUTPUT_WRITING);
+        m_outputStreamer.append(trackingData);
+    } else {
+        m_trackingData.push_back(trackingData);
+    }
 
     if (m_renderDebugVideo) {
         writeDebugFrame(inputFrame);
@@ -93,15 +122,13 @@ bool HCMLabSingleEyePupilTracker::stop()
         m_debugVideoWriter.release();
     }
 
-    writeOutTrackingData();
+    m_outputStreamer.finish();
     return true;
 }
 
-void HCMLabSingleEyePupilTracker::writeOutTrackingData()
+const std::vector<PupilTrackingDataFrame> &HCMLabSingleEyePupilTracker::getTrackingData() const
 {
-    for (const auto &writer : m_outputWriters) {
-        writer->write(m_trackingData);
-    }
+    return m_trackingData;
 }
 
 /***
@@ -116,6 +143,8 @@ void HCMLabSingleEyePupilTracker::writeOutTrackingData()
  */
 void HCMLabSingleEyePupilTracker::writeDebugFrame(const cv::Mat &inputFrame)
 {
+    HCMStageTimer timer(HCMStage::DEBUG_RENDERING);
+
     m_debugOutputMat = cv::Scalar(0, 0, 0);
 
     int videoY = (m_debugOutputSize.height - m_debugVideoEyeSize) / 2; //center source video vertically
@@ -8,7 +8,7 @@
 #include "util/hcmdatatypes.h"
 #include "hcmlabpupiltracker.h"
 #include "hcmlabpupildetector.h"
-#include "outputwriters/hcmlabpupildataoutputwriter.h"
+#include "outputwriters/hcmlabpupildatastreamer.h"
 
 #include "mediapipe/framework/port/opencv_highgui_inc.h"
 #include "mediapipe/framework/port/opencv_imgproc_inc.h"
@@ -20,7 +20,7 @@ class HCMLabSingleEyePupilTracker : public I_HCMLabPupilTracker
 public:
     HCMLabSingleEyePupilTracker(int inputWidth, int inputHeight, double inputfps, bool exportSSIStream,
                        bool exportCSV, bool renderDebugVideo, std::string outputDirPath,
-                       std::string outputBaseName);
+                       std::string outputBaseName, bool fastGradients = false);
 
     ~HCMLabSingleEyePupilTracker()
     {};
@@ -34,17 +34,25 @@ public:
 
     bool stop();
 
+    /// Only collected if the tracker exports neither CSV nor SSI, otherwise the data is streamed into the output files right away
+    const std::vector<PupilTrackingDataFrame> &getTrackingData() const;
+
+    void reset(int inputWidth, int inputHeight, double inputfps, std::string outputDirPath,
+               std::string outputBaseName);
+
 private:
-    void writeDebugFrame(const cv::Mat &inputFrame);
+    /// (re-)creates everything that depends on the video that is processed next
+    void setupForVideo(int inputWidth, int inputHeight, double inputfps, std::string outputDirPath,
+                       std::string outputBaseName);
 
-    void writeOutTrackingData();
+    void writeDebugFrame(const cv::Mat &inputFrame);
 
 private:
     HCMLabPupilDetector m_pupilDetector;
 
     std::vector<PupilTrackingDataFrame> m_trackingData;
 
-    std::vector<std::unique_ptr<HCMLabPupilDataOutputWriter_I>> m_outputWriters;
+    HCMLabPupilDataStreamer m_outputStreamer;
 
     int m_inputWidth, m_inputHeight;
     double m_fps;
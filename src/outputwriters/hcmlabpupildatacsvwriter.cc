@@ -7,21 +7,37 @@
 
 HCMLabPupilDataCSVWriter::HCMLabPupilDataCSVWriter(std::string outputDirPath, std::string baseFileName) : HCMLabPupilDataOutputWriter_I(outputDirPath, baseFileName + "_PUPIL_DATA.csv") {}
 
-void HCMLabPupilDataCSVWriter::write(const std::vector<PupilTrackingDataFrame> &eyeTrackingData)
+void HCMLabPupilDataCSVWriter::begin()
 {
-    std::ofstream csvFile(m_outputDirPath + m_outputFileName);
-    csvFile << "ts, left_diam_abs, left_diam_rel, left_conf, right_diam_abs, right_diam_rel, right_conf\n";
+    m_nrOfAppendedFrames = 0;
+    m_csvFile.open(m_outputDirPath + m_outputFileName, std::ios::out | std::ios::trunc);
+    m_csvFile << "ts, left_diam_abs, left_diam_rel, left_conf, right_diam_abs, right_diam_rel, right_conf\n";
+}
 
-    for (size_t ctr = 0; ctr < eyeTrackingData.size(); ++ctr) {
-        csvFile << ctr << ",";
+void HCMLabPupilDataCSVWriter::append(const std::vector<PupilTrackingDataFrame> &eyeTrackingData)
+{
+    for (const auto &dataFrame : eyeTrackingData) {
+        // only every other frame is written, with its frame number as ts
+        size_t frameNr = m_nrOfAppendedFrames++;
+        if (frameNr % 2 != 0) {
+            continue;
+        }
 
-        auto &leftPupil = eyeTrackingData[ctr].left;
-        csvFile << leftPupil.diameter << "," << leftPupil.diameterRelativeToIris << ", " << leftPupil.confidence << ",";
+        m_csvFile << frameNr << ",";
 
-        auto &rightPupil = eyeTrackingData[ctr].right;
-        csvFile << rightPupil.diameter << "," << rightPupil.diameterRelativeToIris << ", " << rightPupil.confidence;
-        csvFile << "\n";
+        auto &leftPupil = dataFrame.left;
+        m_csvFile << leftPupil.diameter << "," << leftPupil.diameterRelativeToIris << ", " << leftPupil.confidence << ",";
 
-        ctr++;
+        auto &rightPupil = dataFrame.right;
+        m_csvFile << rightPupil.diameter << "," << rightPupil.diameterRelativeToIris << ", " << rightPupil.confidence;
+        m_csvFile << "\n";
     }
-}
\ No newline at end of file
+
+    // keep what was tracked so far on disk, even if the program does not terminate normally
+    m_csvFile.flush();
+}
+
+void HCMLabPupilDataCSVWriter::finish()
+{
+    m_csvFile.close();
+}
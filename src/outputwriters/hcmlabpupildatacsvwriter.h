@@ -3,6 +3,7 @@
 
 #include <string>
 #include <vector>
+#include <fstream>
 
 #include "hcmlabpupildataoutputwriter.h"
 #include "src/util/hcmdatatypes.h"
@@ -19,6 +20,12 @@ public:
     HCMLabPupilDataCSVWriter(std::string outputDirPath, std::string baseFileName);
     ~HCMLabPupilDataCSVWriter(){};
 
-    void write(const std::vector<PupilTrackingDataFrame> &eyeTrackingData) override;
+    void begin() override;
+    void append(const std::vector<PupilTrackingDataFrame> &eyeTrackingData) override;
+    void finish() override;
+
+private:
+    std::ofstream m_csvFile;
+    size_t m_nrOfAppendedFrames = 0;
 };
 #endif // HCMLAB_PUPILDATACSVWRITER_H
\ No newline at end of file
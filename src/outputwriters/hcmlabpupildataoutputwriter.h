@@ -9,19 +9,42 @@
 
 /**
  * Interface for writing out the pupil measurement data to files.
- * Create a subclass which implements the 'write' method for each filetype that should be supported for export.
+ * Create a subclass which implements 'begin', 'append' and 'finish' for each filetype that should be supported for export.
+ *
+ * The data is streamed into the file:
+ * writer.begin();
+ *
+ * while(data)
+ *      writer.append(batchOfFrames);
+ *
+ * writer.finish();
  */
 class HCMLabPupilDataOutputWriter_I
 {
 public:
     HCMLabPupilDataOutputWriter_I() : m_outputDirPath("."), m_outputFileName("output"){};
     HCMLabPupilDataOutputWriter_I(std::string outputDirPath, std::string baseFileName) : m_outputDirPath(outputDirPath), m_outputFileName(baseFileName){};
-    ~HCMLabPupilDataOutputWriter_I(){};
+    virtual ~HCMLabPupilDataOutputWriter_I(){};
 
-    virtual void write(const std::vector<PupilTrackingDataFrame> &eyeTrackingData) = 0;
+    /// Creates the output file(s)
+    virtual void begin() = 0;
+
+    /// Appends the frames to the output file(s), following all frames appended before
+    virtual void append(const std::vector<PupilTrackingDataFrame> &eyeTrackingData) = 0;
+
+    /// Completes and closes the output file(s)
+    virtual void finish() = 0;
+
+    /// Writes out the complete data of a session at once
+    void write(const std::vector<PupilTrackingDataFrame> &eyeTrackingData)
+    {
+        begin();
+        append(eyeTrackingData);
+        finish();
+    }
 
 protected:
     std::string m_outputDirPath;
     std::string m_outputFileName;
 };
-#endif // HCMLAB_PUPILDATAOUTPUTWRITER_I_H
\ No newline at end of file
+#endif // HCMLAB_PUPILDATAOUTPUTWRITER_I_H
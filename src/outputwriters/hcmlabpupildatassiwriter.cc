@@ -5,24 +5,38 @@
 
 HCMLabPupilDataSSIWriter::HCMLabPupilDataSSIWriter(std::string outputDirPath, std::string baseFileName, float inputFPS) : HCMLabPupilDataOutputWriter_I(outputDirPath, baseFileName + "_PUPIL_DATA.stream"), m_fps(inputFPS) {}
 
-void HCMLabPupilDataSSIWriter::write(const std::vector<PupilTrackingDataFrame> &eyeTrackingData)
+void HCMLabPupilDataSSIWriter::begin()
 {
-    createSSIHeaderFile(eyeTrackingData.size());
-
-    std::ofstream streamFile(m_outputDirPath + m_outputFileName + "~");
+    m_nrOfWrittenFrames = 0;
+    createSSIHeaderFile(0);
+    m_streamFile.open(m_outputDirPath + m_outputFileName + "~", std::ios::out | std::ios::binary | std::ios::trunc);
+}
 
-    for (size_t ctr = 0; ctr < eyeTrackingData.size(); ++ctr)
+void HCMLabPupilDataSSIWriter::append(const std::vector<PupilTrackingDataFrame> &eyeTrackingData)
+{
+    for (const auto &dataFrame : eyeTrackingData)
     {
-        auto &leftPupil = eyeTrackingData[ctr].left;
-        streamFile.write((const char *)&(leftPupil.diameter), sizeof(leftPupil.diameter));
-        streamFile.write((const char *)&(leftPupil.diameterRelativeToIris), sizeof(leftPupil.diameterRelativeToIris));
-        streamFile.write((const char *)&(leftPupil.confidence), sizeof(leftPupil.confidence));
-
-        auto &rightPupil = eyeTrackingData[ctr].right;
-        streamFile.write((const char *)&(rightPupil.diameter), sizeof(rightPupil.diameter));
-        streamFile.write((const char *)&(rightPupil.diameterRelativeToIris), sizeof(rightPupil.diameterRelativeToIris));
-        streamFile.write((const char *)&(rightPupil.confidence), sizeof(rightPupil.confidence));
+        auto &leftPupil = dataFrame.left;
+        m_streamFile.write((const char *)&(leftPupil.diameter), sizeof(leftPupil.diameter));
+        m_streamFile.write((const char *)&(leftPupil.diameterRelativeToIris), sizeof(leftPupil.diameterRelativeToIris));
+        m_streamFile.write((const char *)&(leftPupil.confidence), sizeof(leftPupil.confidence));
+
+        auto &rightPupil = dataFrame.right;
+        m_streamFile.write((const char *)&(rightPupil.diameter), sizeof(rightPupil.diameter));
+        m_streamFile.write((const char *)&(rightPupil.diameterRelativeToIris), sizeof(rightPupil.diameterRelativeToIris));
+        m_streamFile.write((const char *)&(rightPupil.confidence), sizeof(rightPupil.confidence));
     }
+    m_nrOfWrittenFrames += eyeTrackingData.size();
+
+    m_streamFile.flush();
+}
+
+void HCMLabPupilDataSSIWriter::finish()
+{
+    m_streamFile.close();
+
+    // now the number of frames is known
+    createSSIHeaderFile(m_nrOfWrittenFrames);
 }
 
 void HCMLabPupilDataSSIWriter::createSSIHeaderFile(const size_t nrOfDataPoints)
@@ -35,4 +49,4 @@ void HCMLabPupilDataSSIWriter::createSSIHeaderFile(const size_t nrOfDataPoints)
                << "    <meta />\n"
                << "    <chunk from=\"0.000000\" to=\"" << nrOfDataPoints / m_fps << "\" byte=\"0\" num=\"" << nrOfDataPoints << "\"/>\n"
                << "</stream>\n";
-}
\ No newline at end of file
+}
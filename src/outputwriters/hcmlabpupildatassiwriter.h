@@ -3,6 +3,7 @@
 
 #include <string>
 #include <vector>
+#include <fstream>
 
 #include "hcmlabpupildataoutputwriter.h"
 #include "src/util/hcmdatatypes.h"
@@ -12,6 +13,8 @@
  * A header file '.stream' is created as well describing the data shape of the binary file.
  * 
  * Empty datapoints are represented as -1.0f
+ *
+ * As the number of frames is only known at the end, the header file is written with zero frames first and rewritten in finish().
  */
 class HCMLabPupilDataSSIWriter : public HCMLabPupilDataOutputWriter_I
 {
@@ -19,12 +22,17 @@ public:
     HCMLabPupilDataSSIWriter(std::string outputDirPath, std::string baseFileName, float inputFPS);
     ~HCMLabPupilDataSSIWriter(){};
 
-    void write(const std::vector<PupilTrackingDataFrame> &eyeTrackingData) override;
+    void begin() override;
+    void append(const std::vector<PupilTrackingDataFrame> &eyeTrackingData) override;
+    void finish() override;
 
 private:
     /// generates the '.stream' xml file describing the shape of the data encoded in the '.stream~' file in the way ssi expects it
     void createSSIHeaderFile(const size_t nrOfDataPoints);
 
     float m_fps; // frames per second of the recorded data
+
+    std::ofstream m_streamFile;
+    size_t m_nrOfWrittenFrames = 0;
 };
 #endif // HCMLAB_PUPILDATASSIWRITER_H
\ No newline at end of file
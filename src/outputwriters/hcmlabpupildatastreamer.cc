@@ -0,0 +1,131 @@
+#include "hcmlabpupildatastreamer.h"
+
+#include <algorithm>
+
+HCMLabPupilDataStreamer::HCMLabPupilDataStreamer(size_t batchSize, size_t maxPendingBatches) :
+    m_batchSize(std::max<size_t>(batchSize, 1)),
+    m_maxPendingBatches(std::max<size_t>(maxPendingBatches, 1)),
+    m_finishRequested(false)
+{
+}
+
+HCMLabPupilDataStreamer::~HCMLabPupilDataStreamer()
+{
+    finish();
+}
+
+void HCMLabPupilDataStreamer::addWriter(std::unique_ptr<HCMLabPupilDataOutputWriter_I> writer)
+{
+    m_writers.push_back(std::move(writer));
+}
+
+void HCMLabPupilDataStreamer::clearWriters()
+{
+    m_writers.clear();
+}
+
+bool HCMLabPupilDataStreamer::hasWriters() const
+{
+    return !m_writers.empty();
+}
+
+void HCMLabPupilDataStreamer::begin()
+{
+    if (m_writers.empty() || m_writerThread.joinable())
+    {
+        return;
+    }
+
+    for (const auto &writer : m_writers)
+    {
+        writer->begin();
+    }
+
+    m_currentBatch.clear();
+    m_currentBatch.reserve(m_batchSize);
+    m_finishRequested = false;
+
+    m_writerThread = std::thread([this] {
+        writeBatches();
+    });
+}
+
+void HCMLabPupilDataStreamer::append(const PupilTrackingDataFrame &dataFrame)
+{
+    if (!m_writerThread.joinable())
+    {
+        return;
+    }
+
+    m_currentBatch.push_back(dataFrame);
+    if (m_currentBatch.size() < m_batchSize)
+    {
+        return;
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(m_batchesMutex);
+        m_batchWritten.wait(lock, [this] {
+            return m_pendingBatches.size() < m_maxPendingBatches;
+        });
+        m_pendingBatches.push_back(std::move(m_currentBatch));
+    }
+    m_batchAvailable.notify_one();
+
+    m_currentBatch = std::vector<PupilTrackingDataFrame>();
+    m_currentBatch.reserve(m_batchSize);
+}
+
+void HCMLabPupilDataStreamer::finish()
+{
+    if (!m_writerThread.joinable())
+    {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_batchesMutex);
+        if (!m_currentBatch.empty())
+        {
+            m_pendingBatches.push_back(std::move(m_currentBatch));
+            m_currentBatch = std::vector<PupilTrackingDataFrame>();
+        }
+        m_finishRequested = true;
+    }
+    m_batchAvailable.notify_one();
+
+    m_writerThread.join();
+
+    for (const auto &writer : m_writers)
+    {
+        writer->finish();
+    }
+}
+
+void HCMLabPupilDataStreamer::writeBatches()
+{
+    while (true)
+    {
+        std::vector<PupilTrackingDataFrame> batch;
+        {
+            std::unique_lock<std::mutex> lock(m_batchesMutex);
+            m_batchAvailable.wait(lock, [this] {
+                return !m_pendingBatches.empty() || m_finishRequested;
+            });
+
+            if (m_pendingBatches.empty())
+            {
+                break; // finish was requested and everything is written
+            }
+
+            batch = std::move(m_pendingBatches.front());
+            m_pendingBatches.pop_front();
+        }
+        m_batchWritten.notify_one();
+
+        for (const auto &writer : m_writers)
+        {
+            writer->append(batch);
+        }
+    }
+}
@@ -0,0 +1,68 @@
+#ifndef HCMLAB_PUPILDATASTREAMER_H
+#define HCMLAB_PUPILDATASTREAMER_H
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "hcmlabpupildataoutputwriter.h"
+#include "src/util/hcmdatatypes.h"
+
+/**
+ * Streams the pupil data of a session into a set of output writers while it is being tracked.
+ * Frames are collected in batches, which are handed to a background thread that appends them to all writers.
+ * This way the tracking data does not need to be kept in memory for the whole session
+ * and the file I/O does not block the tracking.
+ * If the writers fall behind (e.g. on a slow disk), append() blocks once maxPendingBatches batches wait to be written,
+ * so the memory stays bounded.
+ *
+ * Follows the paradigm of calling:
+ * streamer.addWriter(...);
+ * streamer.begin();
+ *
+ * while(data)
+ *      streamer.append(dataFrame);
+ *
+ * streamer.finish(); //writes the remaining frames and completes the files
+ */
+class HCMLabPupilDataStreamer
+{
+public:
+    HCMLabPupilDataStreamer(size_t batchSize = 64, size_t maxPendingBatches = 16);
+    ~HCMLabPupilDataStreamer();
+
+    /// Must not be called between begin() and finish()
+    void addWriter(std::unique_ptr<HCMLabPupilDataOutputWriter_I> writer);
+
+    /// Must not be called between begin() and finish()
+    void clearWriters();
+
+    bool hasWriters() const;
+
+    void begin();
+    void append(const PupilTrackingDataFrame &dataFrame);
+    void finish();
+
+private:
+    void writeBatches();
+
+    std::vector<std::unique_ptr<HCMLabPupilDataOutputWriter_I>> m_writers;
+
+    size_t m_batchSize;
+    std::vector<PupilTrackingDataFrame> m_currentBatch;
+
+    std::deque<std::vector<PupilTrackingDataFrame>> m_pendingBatches;
+    size_t m_maxPendingBatches;
+    bool m_finishRequested;
+
+    std::mutex m_batchesMutex;
+    std::condition_variable m_batchAvailable;
+    std::condition_variable m_batchWritten; // signalled whenever the writer thread takes a batch, so a blocked append() can continue
+
+    std::thread m_writerThread;
+};
+
+#endif // HCMLAB_PUPILDATASTREAMER_H
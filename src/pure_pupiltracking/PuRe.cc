@@ -36,11 +36,17 @@
  * MODIFICATIONS.
  */
 
+#include <algorithm>
+#include <bitset>
 #include <climits>
+#include <cstdint>
+#include <initializer_list>
+#include <iterator>
 #include <iostream>
 
 #include "PuRe.h"
 #include "mediapipe/framework/port/opencv_highgui_inc.h"
+#include "opencv2/core/hal/intrin.hpp"
 
 //#define SAVE_ILLUSTRATION
 
@@ -51,7 +57,10 @@ string PuRe::desc = "PuRe (Santini et. al 2018a)";
 
 PuRe::PuRe() : baseSize(320, 240),
                expectedFrameSize(-1, -1),
-               outlineBias(5)
+               outlineBias(5),
+               gradientMode(REFERENCE_GRADIENT),
+               lowThreshold(0),
+               highThreshold(0)
 {
     mDesc = desc;
 
@@ -109,6 +118,168 @@ void PuRe::init(const Mat &frame)
     scalingRatio = min<float>(min<float>(rw, rh), 1.0);
 }
 
+void PuRe::prepareWorkspace(const Size &size)
+{
+    // no need to zero anything here: the derivatives and the magnitude are completely overwritten,
+    // edgeType and edge are cleared by canny itself
+    dx = workspace.get(PuReWorkspace::DX, size, CV_32F);
+    dy = workspace.get(PuReWorkspace::DY, size, CV_32F);
+    magnitude = workspace.get(PuReWorkspace::MAGNITUDE, size, CV_32F);
+    edgeType = workspace.get(PuReWorkspace::EDGE_TYPE, size, CV_8U);
+    edge = workspace.get(PuReWorkspace::EDGE, size, CV_8U);
+}
+
+/*
+ * Non maximum suppression of the pixels [jBegin, jEnd) of a single row.
+ * p_res_t, p_res and p_res_b are the magnitudes of the rows above, at and below the current one.
+ */
+static inline void suppressNonMaxima(const float *p_res_t, const float *p_res, const float *p_res_b, const float *p_x, const float *p_y,
+                                     const float low_th, const float high_th, uchar *_edgeType, int jBegin, int jEnd)
+{
+    const float tg22_5 = 0.4142135623730950488016887242097f;
+    const float tg67_5 = 2.4142135623730950488016887242097f;
+
+    for (int j = jBegin; j < jEnd; j++)
+    {
+        _edgeType[j] = 0;
+
+        float m = p_res[j];
+        if (m < low_th)
+            continue;
+
+        float iy = p_y[j];
+        float ix = p_x[j];
+        float y = abs((double)iy);
+        float x = abs((double)ix);
+
+        uchar val = p_res[j] > high_th ? 255 : 128;
+
+        float tg22_5x = tg22_5 * x;
+        if (y < tg22_5x)
+        {
+            if (m > p_res[j - 1] && m >= p_res[j + 1])
+                _edgeType[j] = val;
+        }
+        else
+        {
+            float tg67_5x = tg67_5 * x;
+            if (y > tg67_5x)
+            {
+                if (m > p_res_b[j] && m >= p_res_t[j])
+                    _edgeType[j] = val;
+            }
+            else
+            {
+                if ((iy <= 0) == (ix <= 0))
+                {
+                    if (m > p_res_t[j - 1] && m >= p_res_b[j + 1])
+                        _edgeType[j] = val;
+                }
+                else
+                {
+                    if (m > p_res_b[j - 1] && m >= p_res_t[j + 1])
+                        _edgeType[j] = val;
+                }
+            }
+        }
+    }
+}
+
+#if CV_SIMD128
+/*
+ * Branchless version of suppressNonMaxima() that handles 16 pixels per iteration.
+ * Every direction and neighbour comparison is evaluated as a lane mask and the matching one is selected,
+ * which gives exactly the scalar results. Returns the first pixel that was not processed.
+ * Only the 128 bit types are used, the OpenCV 3.2 of Ubuntu 18.04 (see the Dockerfile) has no wider ones.
+ */
+static inline int suppressNonMaximaSIMD(const float *p_res_t, const float *p_res, const float *p_res_b, const float *p_x, const float *p_y,
+                                        const float low_th, const float high_th, uchar *_edgeType, int jBegin, int jEnd)
+{
+    const v_float32x4 v_tg22_5 = v_setall_f32(0.4142135623730950488016887242097f);
+    const v_float32x4 v_tg67_5 = v_setall_f32(2.4142135623730950488016887242097f);
+    const v_float32x4 v_low_th = v_setall_f32(low_th);
+    const v_float32x4 v_high_th = v_setall_f32(high_th);
+    const v_float32x4 v_zero = v_setzero_f32();
+    const v_uint8x16 v_weak = v_setall_u8(128);
+
+    int j = jBegin;
+    // the neighbours of the last pixel of a block are read too, so it has to end before jEnd
+    for (; j + 16 <= jEnd; j += 16)
+    {
+        v_int32x4 isMaximum[4], isStrong[4];
+        for (int k = 0; k < 4; k++)
+        {
+            int jk = j + 4 * k;
+            v_float32x4 m = v_load(p_res + jk);
+            v_float32x4 ix = v_load(p_x + jk);
+            v_float32x4 iy = v_load(p_y + jk);
+            v_float32x4 x = v_abs(ix);
+            v_float32x4 y = v_abs(iy);
+
+            v_float32x4 horizontal = y < v_tg22_5 * x;
+            v_float32x4 vertical = y > v_tg67_5 * x;
+            v_float32x4 sameSign = ~((iy <= v_zero) ^ (ix <= v_zero));
+
+            v_float32x4 maxHorizontal = (m > v_load(p_res + jk - 1)) & (m >= v_load(p_res + jk + 1));
+            v_float32x4 maxVertical = (m > v_load(p_res_b + jk)) & (m >= v_load(p_res_t + jk));
+            v_float32x4 maxDiagonal = (m > v_load(p_res_t + jk - 1)) & (m >= v_load(p_res_b + jk + 1));
+            v_float32x4 maxAntiDiagonal = (m > v_load(p_res_b + jk - 1)) & (m >= v_load(p_res_t + jk + 1));
+
+            v_float32x4 isMax = v_select(horizontal, maxHorizontal,
+                                         v_select(vertical, maxVertical,
+                                                  v_select(sameSign, maxDiagonal, maxAntiDiagonal)));
+            isMax = isMax & ~(m < v_low_th);
+
+            isMaximum[k] = v_reinterpret_as_s32(isMax);
+            isStrong[k] = v_reinterpret_as_s32(m > v_high_th);
+        }
+
+        // the masks are all-ones (-1) or all-zeros, so signed saturating packs narrow them to 0xFF or 0x00 per pixel.
+        // Unsigned packs must not be used: SSE treats their input as signed and saturates -1 to 0
+        v_uint8x16 maximum = v_reinterpret_as_u8(v_pack(v_pack(isMaximum[0], isMaximum[1]), v_pack(isMaximum[2], isMaximum[3])));
+        v_uint8x16 strong = v_reinterpret_as_u8(v_pack(v_pack(isStrong[0], isStrong[1]), v_pack(isStrong[2], isStrong[3])));
+        v_store(_edgeType + j, maximum & (strong | v_weak));
+    }
+    return j;
+}
+#endif
+
+void PuRe::fastGradients(const Mat &in, bool blurImage)
+{
+    /*
+     * The 7x7 Sobel kernels are the 3x3 ones smoothed by a 5x5 binomial filter (variance 1 along each axis).
+     * That smoothing and the optional 5x5 Gaussian (sigma 1.5) in front of it are folded into a single fixed-point
+     * Gaussian blur of the 8 bit image, after which spatialGradient() yields dx and dy in one 16 bit pass.
+     * Only the scale of the magnitude differs from the reference, which does not matter as the thresholds are relative.
+     */
+    CV_Assert(in.type() == CV_8UC1);
+    double sigma = blurImage ? sqrt(1.5 * 1.5 + 1.0) : 1.0;
+    Mat blurred = workspace.get(PuReWorkspace::BLURRED, in.size(), CV_8U);
+    GaussianBlur(in, blurred, Size(9, 9), sigma, sigma, BORDER_REPLICATE);
+
+    Mat dx16 = workspace.get(PuReWorkspace::DX_16S, in.size(), CV_16S);
+    Mat dy16 = workspace.get(PuReWorkspace::DY_16S, in.size(), CV_16S);
+    spatialGradient(blurred, dx16, dy16, 3, BORDER_REPLICATE);
+
+    // the rest of canny() works on float gradients
+    for (int i = 0; i < in.rows; i++)
+    {
+        const short *p_dx16 = dx16.ptr<short>(i);
+        const short *p_dy16 = dy16.ptr<short>(i);
+        float *p_x = dx.ptr<float>(i);
+        float *p_y = dy.ptr<float>(i);
+        float *p_res = magnitude.ptr<float>(i);
+        for (int j = 0; j < in.cols; j++)
+        {
+            float x = p_dx16[j];
+            float y = p_dy16[j];
+            p_x[j] = x;
+            p_y[j] = y;
+            p_res[j] = std::sqrt(x * x + y * y);
+        }
+    }
+}
+
 Mat PuRe::canny(const Mat &in, bool blurImage, bool useL2, int bins, float nonEdgePixelsRatio, float lowHighThresholdRatio)
 {
     (void)useL2;
@@ -116,27 +287,32 @@ Mat PuRe::canny(const Mat &in, bool blurImage, bool useL2, int bins, float nonEd
 	 * Smoothing and directional derivatives
 	 * TODO: adapt sizes to image size
 	 */
-    Mat blurred;
-    if (blurImage)
-    {
-        Size blurSize(5, 5);
-        GaussianBlur(in, blurred, blurSize, 1.5, 1.5, BORDER_REPLICATE);
-    }
+    if (gradientMode == FAST_GRADIENT)
+        fastGradients(in, blurImage);
     else
-        blurred = in;
+    {
+        Mat blurred;
+        if (blurImage)
+        {
+            blurred = workspace.get(PuReWorkspace::BLURRED, in.size(), in.type());
+            Size blurSize(5, 5);
+            GaussianBlur(in, blurred, blurSize, 1.5, 1.5, BORDER_REPLICATE);
+        }
+        else
+            blurred = in;
 
-    Sobel(blurred, dx, dx.type(), 1, 0, 7, 1, BORDER_REPLICATE);
-    Sobel(blurred, dy, dy.type(), 0, 1, 7, 1, BORDER_REPLICATE);
+        Sobel(blurred, dx, dx.type(), 1, 0, 7, 1, BORDER_REPLICATE);
+        Sobel(blurred, dy, dy.type(), 0, 1, 7, 1, BORDER_REPLICATE);
+
+        cv::magnitude(dx, dy, magnitude);
+    }
 
     /*
 	 *  Magnitude
 	 */
     double minMag = 0;
     double maxMag = 0;
-    float *p_res;
-    float *p_x, *p_y; // result, x, y
 
-    cv::magnitude(dx, dy, magnitude);
     cv::minMaxLoc(magnitude, &minMag, &maxMag);
 
     /*
@@ -145,19 +321,17 @@ Mat PuRe::canny(const Mat &in, bool blurImage, bool useL2, int bins, float nonEd
     float low_th = 0;
     float high_th = 0;
 
-    // Normalization
-    magnitude = magnitude / maxMag;
-
-    // Histogram
-    int *histogram = new int[bins]();
-    Mat res_idx = (bins - 1) * magnitude;
-    res_idx.convertTo(res_idx, CV_16U);
-    short *p_res_idx = 0;
-    for (int i = 0; i < res_idx.rows; i++)
+    // Histogram of the normalized magnitude, with the bin computed straight from the magnitude.
+    // A flat image has no gradients at all, every pixel then falls into the first bin
+    const int maxBins = 256;
+    bins = std::min(std::max(bins, 1), maxBins);
+    int histogram[maxBins] = {0};
+    const float toBin = maxMag > 0 ? static_cast<float>((bins - 1) / maxMag) : 0.0f;
+    for (int i = 0; i < magnitude.rows; i++)
     {
-        p_res_idx = res_idx.ptr<short>(i);
-        for (int j = 0; j < res_idx.cols; j++)
-            histogram[p_res_idx[j]]++;
+        const float *p_res = magnitude.ptr<float>(i);
+        for (int j = 0; j < magnitude.cols; j++)
+            histogram[cvRound(p_res[j] * toBin)]++;
     }
 
     // Ratio
@@ -174,70 +348,35 @@ Mat PuRe::canny(const Mat &in, bool blurImage, bool useL2, int bins, float nonEd
     }
     low_th = lowHighThresholdRatio * high_th;
 
-    delete[] histogram;
+    // The thresholds are relative to the maximum magnitude. Scaling them instead of normalizing the magnitude
+    // saves a pass over the image and keeps the neighbour comparisons of the non maximum suppression intact
+    low_th *= maxMag;
+    high_th *= maxMag;
+    lowThreshold = low_th;
+    highThreshold = high_th;
 
     /*
 	 *  Non maximum supression
 	 */
-    const float tg22_5 = 0.4142135623730950488016887242097f;
-    const float tg67_5 = 2.4142135623730950488016887242097f;
-    uchar *_edgeType;
-    float *p_res_b, *p_res_t;
-    edgeType.setTo(0);
+    // every interior pixel is written below, so only the border has to be cleared
+    edgeType.row(0).setTo(0);
+    edgeType.row(edgeType.rows - 1).setTo(0);
+    edgeType.col(0).setTo(0);
+    edgeType.col(edgeType.cols - 1).setTo(0);
     for (int i = 1; i < magnitude.rows - 1; i++)
     {
-        _edgeType = edgeType.ptr<uchar>(i);
-
-        p_res = magnitude.ptr<float>(i);
-        p_res_t = magnitude.ptr<float>(i - 1);
-        p_res_b = magnitude.ptr<float>(i + 1);
-
-        p_x = dx.ptr<float>(i);
-        p_y = dy.ptr<float>(i);
-
-        for (int j = 1; j < magnitude.cols - 1; j++)
-        {
-
-            float m = p_res[j];
-            if (m < low_th)
-                continue;
-
-            float iy = p_y[j];
-            float ix = p_x[j];
-            float y = abs((double)iy);
-            float x = abs((double)ix);
-
-            uchar val = p_res[j] > high_th ? 255 : 128;
-
-            float tg22_5x = tg22_5 * x;
-            if (y < tg22_5x)
-            {
-                if (m > p_res[j - 1] && m >= p_res[j + 1])
-                    _edgeType[j] = val;
-            }
-            else
-            {
-                float tg67_5x = tg67_5 * x;
-                if (y > tg67_5x)
-                {
-                    if (m > p_res_b[j] && m >= p_res_t[j])
-                        _edgeType[j] = val;
-                }
-                else
-                {
-                    if ((iy <= 0) == (ix <= 0))
-                    {
-                        if (m > p_res_t[j - 1] && m >= p_res_b[j + 1])
-                            _edgeType[j] = val;
-                    }
-                    else
-                    {
-                        if (m > p_res_b[j - 1] && m >= p_res_t[j + 1])
-                            _edgeType[j] = val;
-                    }
-                }
-            }
-        }
+        const float *p_res_t = magnitude.ptr<float>(i - 1);
+        const float *p_res = magnitude.ptr<float>(i);
+        const float *p_res_b = magnitude.ptr<float>(i + 1);
+        const float *p_x = dx.ptr<float>(i);
+        const float *p_y = dy.ptr<float>(i);
+        uchar *_edgeType = edgeType.ptr<uchar>(i);
+
+        int j = 1;
+#if CV_SIMD128
+        j = suppressNonMaximaSIMD(p_res_t, p_res, p_res_b, p_x, p_y, low_th, high_th, _edgeType, j, magnitude.cols - 1);
+#endif
+        suppressNonMaxima(p_res_t, p_res, p_res_b, p_x, p_y, low_th, high_th, _edgeType, j, magnitude.cols - 1);
     }
 
     /*
@@ -246,29 +385,33 @@ Mat PuRe::canny(const Mat &in, bool blurImage, bool useL2, int bins, float nonEd
     int pic_x = edgeType.cols;
     int pic_y = edgeType.rows;
     int area = pic_x * pic_y;
-    int lines_idx = 0;
     int idx = 0;
 
-    vector<int> lines;
+    // every pixel is pushed at most once, so the stack can never hold more than the whole image
+    if (workspace.hysteresisStack.size() < static_cast<size_t>(area))
+        workspace.hysteresisStack.resize(area);
+    int *lines = workspace.hysteresisStack.data();
+    const uchar *p_edgeType = edgeType.data;
+    uchar *p_edge = edge.data;
+
     edge.setTo(0);
     for (int i = 1; i < pic_y - 1; i++)
     {
         for (int j = 1; j < pic_x - 1; j++)
         {
 
-            if (edgeType.data[idx + j] != 255 || edge.data[idx + j] != 0)
+            if (p_edgeType[idx + j] != 255 || p_edge[idx + j] != 0)
                 continue;
 
-            edge.data[idx + j] = 255;
-            lines_idx = 1;
-            lines.clear();
-            lines.push_back(idx + j);
-            int akt_idx = 0;
+            // the strong edges connected to this seed are the same no matter in which order they are visited,
+            // so a stack does the job of the original breadth-first queue
+            p_edge[idx + j] = 255;
+            int lines_idx = 0;
+            lines[lines_idx++] = idx + j;
 
-            while (akt_idx < lines_idx)
+            while (lines_idx > 0)
             {
-                int akt_pos = lines[akt_idx];
-                akt_idx++;
+                int akt_pos = lines[--lines_idx];
 
                 if (akt_pos - pic_x - 1 < 0 || akt_pos + pic_x + 1 >= area)
                     continue;
@@ -276,11 +419,11 @@ Mat PuRe::canny(const Mat &in, bool blurImage, bool useL2, int bins, float nonEd
                 for (int k1 = -1; k1 < 2; k1++)
                     for (int k2 = -1; k2 < 2; k2++)
                     {
-                        if (edge.data[(akt_pos + (k1 * pic_x)) + k2] != 0 || edgeType.data[(akt_pos + (k1 * pic_x)) + k2] == 0)
+                        int pos = akt_pos + (k1 * pic_x) + k2;
+                        if (p_edge[pos] != 0 || p_edgeType[pos] == 0)
                             continue;
-                        edge.data[(akt_pos + (k1 * pic_x)) + k2] = 255;
-                        lines.push_back((akt_pos + (k1 * pic_x)) + k2);
-                        lines_idx++;
+                        p_edge[pos] = 255;
+                        lines[lines_idx++] = pos;
                     }
             }
         }
@@ -290,240 +433,291 @@ Mat PuRe::canny(const Mat &in, bool blurImage, bool useL2, int bins, float nonEd
     return edge;
 }
 
-void PuRe::filterEdges(cv::Mat &edges)
+/*
+ * Edge filtering on a bitmap of the edge image.
+ * The neighbourhood of an edge pixel is packed into a bit mask (7x7 pixels, row by row, the pixel itself at bit 24)
+ * and matched against the patterns of the filter, which are built once from their pixel offsets.
+ */
+static inline uint64_t windowBit(int dx, int dy) { return uint64_t(1) << ((dy + 3) * 7 + (dx + 3)); }
+
+static uint64_t windowBits(std::initializer_list<Point> offsets)
 {
-    // TODO: there is room for improvement here; however, it is prone to small
-    // mistakes; will be done when we have time
-    int start_x = 5;
-    int start_y = 5;
-    int end_x = edges.cols - 5;
-    int end_y = edges.rows - 5;
+    uint64_t bits = 0;
+    for (const Point &offset : offsets)
+        bits |= windowBit(offset.x, offset.y);
+    return bits;
+}
 
-    for (int j = start_y; j < end_y; j++)
-        for (int i = start_x; i < end_x; i++)
-        {
-            uchar box[9];
+struct EdgePattern
+{
+    uint64_t mask;  // pixels of the window the pattern looks at
+    uint64_t value; // the values these pixels must have
+    uint64_t clear; // pixels that are removed where the pattern matches
+    uint64_t set;   // pixels that are added where the pattern matches
 
-            box[4] = (uchar)edges.data[(edges.cols * (j)) + (i)];
+    EdgePattern(std::initializer_list<Point> on, std::initializer_list<Point> off,
+                std::initializer_list<Point> clearPixels = {}, std::initializer_list<Point> setPixels = {})
+        : mask(windowBits(on) | windowBits(off)), value(windowBits(on)), clear(windowBits(clearPixels)), set(windowBits(setPixels)) {}
 
-            if (box[4])
-            {
-                box[1] = (uchar)edges.data[(edges.cols * (j - 1)) + (i)];
-                box[3] = (uchar)edges.data[(edges.cols * (j)) + (i - 1)];
-                box[5] = (uchar)edges.data[(edges.cols * (j)) + (i + 1)];
-                box[7] = (uchar)edges.data[(edges.cols * (j + 1)) + (i)];
-
-                if ((box[5] && box[7]))
-                    edges.data[(edges.cols * (j)) + (i)] = 0;
-                if ((box[5] && box[1]))
-                    edges.data[(edges.cols * (j)) + (i)] = 0;
-                if ((box[3] && box[7]))
-                    edges.data[(edges.cols * (j)) + (i)] = 0;
-                if ((box[3] && box[1]))
-                    edges.data[(edges.cols * (j)) + (i)] = 0;
-            }
-        }
+    bool matches(uint64_t window) const { return (window & mask) == value; }
+};
 
-    //too many neigbours
-    for (int j = start_y; j < end_y; j++)
-        for (int i = start_x; i < end_x; i++)
+class EdgeBitmap
+{
+public:
+    EdgeBitmap(const uchar *data, size_t step, int rows, int cols, std::vector<uint64_t> &memory)
+        : rows(rows), cols(cols), wordsPerRow((cols + 63) / 64 + 1) // one word of padding, so 7 bits can always be read from two words
+    {
+        memory.assign(static_cast<size_t>(rows) * wordsPerRow, 0);
+        words = memory.data();
+        for (int y = 0; y < rows; y++)
         {
-            uchar neig = 0;
+            const uchar *p = data + y * step;
+            uint64_t *row = words + static_cast<size_t>(y) * wordsPerRow;
+            for (int x = 0; x < cols; x++)
+                if (p[x])
+                    row[x >> 6] |= uint64_t(1) << (x & 63);
+        }
+    }
 
-            for (int k1 = -1; k1 < 2; k1++)
-                for (int k2 = -1; k2 < 2; k2++)
+    // writes the changes back: removed pixels become 0, added pixels 255, all other pixels keep their value
+    void store(uchar *data, size_t step) const
+    {
+        for (int y = 0; y < rows; y++)
+        {
+            uchar *p = data + y * step;
+            const uint64_t *row = words + static_cast<size_t>(y) * wordsPerRow;
+            for (int x = 0; x < cols; x++)
+            {
+                if ((row[x >> 6] >> (x & 63)) & 1)
                 {
-
-                    if (edges.data[(edges.cols * (j + k1)) + (i + k2)] > 0)
-                        neig++;
+                    if (!p[x])
+                        p[x] = 255;
                 }
-
-            if (neig > 3)
-                edges.data[(edges.cols * (j)) + (i)] = 0;
+                else
+                    p[x] = 0;
+            }
         }
+    }
 
-    for (int j = start_y; j < end_y; j++)
-        for (int i = start_x; i < end_x; i++)
-        {
-            uchar box[17];
+    void clear(int x, int y) { words[static_cast<size_t>(y) * wordsPerRow + (x >> 6)] &= ~(uint64_t(1) << (x & 63)); }
+    void set(int x, int y) { words[static_cast<size_t>(y) * wordsPerRow + (x >> 6)] |= uint64_t(1) << (x & 63); }
 
-            box[4] = (uchar)edges.data[(edges.cols * (j)) + (i)];
+    // applies the pixels of a window mask relative to (x, y)
+    void clear(uint64_t window, int x, int y)
+    {
+        for (; window; window &= window - 1)
+        {
+            int bit = __builtin_ctzll(window);
+            clear(x + bit % 7 - 3, y + bit / 7 - 3);
+        }
+    }
+    void set(uint64_t window, int x, int y)
+    {
+        for (; window; window &= window - 1)
+        {
+            int bit = __builtin_ctzll(window);
+            set(x + bit % 7 - 3, y + bit / 7 - 3);
+        }
+    }
 
-            if (box[4])
-            {
-                box[0] = (uchar)edges.data[(edges.cols * (j - 1)) + (i - 1)];
-                box[1] = (uchar)edges.data[(edges.cols * (j - 1)) + (i)];
-                box[2] = (uchar)edges.data[(edges.cols * (j - 1)) + (i + 1)];
+    // the 3x3 (9 bit) or 7x7 (49 bit) neighbourhood of (x, y)
+    uint64_t window3(int x, int y) const { return bits(x - 1, y - 1, 3) | bits(x - 1, y, 3) << 3 | bits(x - 1, y + 1, 3) << 6; }
+    uint64_t window7(int x, int y) const
+    {
+        uint64_t window = 0;
+        for (int dy = -3; dy <= 3; dy++)
+            window |= bits(x - 3, y + dy, 7) << ((dy + 3) * 7);
+        return window;
+    }
 
-                box[3] = (uchar)edges.data[(edges.cols * (j)) + (i - 1)];
-                box[5] = (uchar)edges.data[(edges.cols * (j)) + (i + 1)];
+    // first edge pixel of row y in [from, end), or end
+    int nextEdge(int y, int from, int end) const
+    {
+        const uint64_t *row = words + static_cast<size_t>(y) * wordsPerRow;
+        int w = from >> 6;
+        uint64_t word = row[w] & (~uint64_t(0) << (from & 63));
+        while (!word)
+        {
+            if (++w * 64 >= end)
+                return end;
+            word = row[w];
+        }
+        return std::min(w * 64 + __builtin_ctzll(word), end);
+    }
 
-                box[6] = (uchar)edges.data[(edges.cols * (j + 1)) + (i - 1)];
-                box[7] = (uchar)edges.data[(edges.cols * (j + 1)) + (i)];
-                box[8] = (uchar)edges.data[(edges.cols * (j + 1)) + (i + 1)];
+private:
+    // width (< 8) bits of row y, starting at column x
+    uint64_t bits(int x, int y, int width) const
+    {
+        const uint64_t *row = words + static_cast<size_t>(y) * wordsPerRow;
+        int w = x >> 6;
+        int s = x & 63;
+        uint64_t b = row[w] >> s;
+        if (s > 64 - width)
+            b |= row[w + 1] << (64 - s);
+        return b & ((uint64_t(1) << width) - 1);
+    }
 
-                //external
-                box[9] = (uchar)edges.data[(edges.cols * (j)) + (i + 2)];
-                box[10] = (uchar)edges.data[(edges.cols * (j + 2)) + (i)];
+    int rows, cols, wordsPerRow;
+    uint64_t *words;
+};
 
-                box[11] = (uchar)edges.data[(edges.cols * (j)) + (i + 3)];
-                box[12] = (uchar)edges.data[(edges.cols * (j - 1)) + (i + 2)];
-                box[13] = (uchar)edges.data[(edges.cols * (j + 1)) + (i + 2)];
+static void filterEdgeBitmap(uchar *data, size_t step, int rows, int cols, std::vector<uint64_t> &memory)
+{
+    // 3x3 neighbourhoods (bit (dy + 1) * 3 + dx + 1) that remove their center pixel
+    static const std::vector<uchar> isCorner = [] {
+        // an edge pixel with a horizontal and a vertical neighbour only thickens the edge
+        std::vector<uchar> table(512);
+        for (int code = 0; code < 512; code++)
+            table[code] = ((code >> 1 & 1) || (code >> 7 & 1)) && ((code >> 3 & 1) || (code >> 5 & 1));
+        return table;
+    }();
+    static const std::vector<uchar> hasTooManyNeighbours = [] {
+        std::vector<uchar> table(512);
+        for (int code = 0; code < 512; code++)
+            table[code] = std::bitset<9>(code).count() > 3;
+        return table;
+    }();
+
+    // straightens diagonal steps into vertical and horizontal lines
+    static const std::vector<EdgePattern> straighteningPatterns = {
+        // vertical: a pixel two rows below, but none right below
+        {{{0, 2}, {1, 1}}, {{0, 1}}, {{-1, 1}, {1, 1}}, {{0, 1}}},
+        {{{0, 2}, {-1, 1}}, {{0, 1}}, {{-1, 1}, {1, 1}}, {{0, 1}}},
+        // vertical: a pixel three rows below, but none in between
+        {{{0, 3}, {1, 1}, {1, 2}}, {{0, 1}, {0, 2}}, {{1, 1}, {-1, 1}, {1, 2}, {-1, 2}}, {{0, 1}, {0, 2}}},
+        {{{0, 3}, {1, 1}, {-1, 2}}, {{0, 1}, {0, 2}}, {{1, 1}, {-1, 1}, {1, 2}, {-1, 2}}, {{0, 1}, {0, 2}}},
+        {{{0, 3}, {-1, 1}, {1, 2}}, {{0, 1}, {0, 2}}, {{1, 1}, {-1, 1}, {1, 2}, {-1, 2}}, {{0, 1}, {0, 2}}},
+        {{{0, 3}, {-1, 1}, {-1, 2}}, {{0, 1}, {0, 2}}, {{1, 1}, {-1, 1}, {1, 2}, {-1, 2}}, {{0, 1}, {0, 2}}},
+        // horizontal: a pixel two columns to the right, but none right next to it
+        {{{2, 0}, {1, 1}}, {{1, 0}}, {{1, 1}, {1, -1}}, {{1, 0}}},
+        {{{2, 0}, {1, -1}}, {{1, 0}}, {{1, 1}, {1, -1}}, {{1, 0}}},
+        // horizontal: a pixel three columns to the right, but none in between
+        {{{3, 0}, {1, 1}, {2, 1}}, {{1, 0}, {2, 0}}, {{1, 1}, {1, -1}, {2, 1}, {2, -1}}, {{1, 0}, {2, 0}}},
+        {{{3, 0}, {1, 1}, {2, -1}}, {{1, 0}, {2, 0}}, {{1, 1}, {1, -1}, {2, 1}, {2, -1}}, {{1, 0}, {2, 0}}},
+        {{{3, 0}, {1, -1}, {2, 1}}, {{1, 0}, {2, 0}}, {{1, 1}, {1, -1}, {2, 1}, {2, -1}}, {{1, 0}, {2, 0}}},
+        {{{3, 0}, {1, -1}, {2, -1}}, {{1, 0}, {2, 0}}, {{1, 1}, {1, -1}, {2, 1}, {2, -1}}, {{1, 0}, {2, 0}}},
+    };
+
+    // removes the center pixel where edges branch off or form sharp corners
+    static const std::vector<EdgePattern> removalPatterns = {
+        {{{0, 1}, {1, -1}, {2, -1}}, {}},
+        {{{0, 1}, {-1, -1}, {-2, -1}}, {}},
+        {{{0, -1}, {1, 1}, {2, 1}}, {}},
+        {{{0, -1}, {-1, 1}, {-2, 1}}, {}},
+
+        {{{-1, -1}, {-1, -2}, {-1, -3}, {1, 1}, {2, 1}, {3, 1}}, {}},
+        {{{1, -1}, {1, -2}, {1, -3}, {-1, 1}, {-2, 1}, {-3, 1}}, {}},
+        {{{-1, 1}, {-1, 2}, {-1, 3}, {1, -1}, {2, -1}, {3, -1}}, {}},
+        {{{1, 1}, {1, 2}, {1, 3}, {-1, -1}, {-2, -1}, {-3, -1}}, {}},
+
+        {{{-1, -1}, {-2, -2}, {1, -1}, {2, -2}}, {}},
+        {{{-1, -1}, {-2, -2}, {-1, 1}, {-2, 2}}, {}},
+        {{{1, 1}, {2, 2}, {1, -1}, {2, -2}}, {}},
+        {{{1, 1}, {2, 2}, {-1, 1}, {-2, 2}}, {}},
+
+        {{{-1, 0}, {-2, -1}, {-3, -2}, {1, -1}, {2, -2}}, {}},
+        {{{-1, 0}, {-2, 1}, {-3, 2}, {1, 1}, {2, 2}}, {}},
+        {{{0, 1}, {1, 2}, {2, 3}, {1, -1}, {2, -2}}, {}},
+        {{{0, 1}, {-1, 2}, {-2, 3}, {-1, -1}, {-2, -2}}, {}},
+    };
 
-                box[14] = (uchar)edges.data[(edges.cols * (j + 3)) + (i)];
-                box[15] = (uchar)edges.data[(edges.cols * (j + 2)) + (i - 1)];
-                box[16] = (uchar)edges.data[(edges.cols * (j + 2)) + (i + 1)];
+    int start_x = 5;
+    int start_y = 5;
+    int end_x = cols - 5;
+    int end_y = rows - 5;
+    if (end_x <= start_x || end_y <= start_y)
+        return;
 
-                if ((box[10] && !box[7]) && (box[8] || box[6]))
-                {
-                    edges.data[(edges.cols * (j + 1)) + (i - 1)] = 0;
-                    edges.data[(edges.cols * (j + 1)) + (i + 1)] = 0;
-                    edges.data[(edges.cols * (j + 1)) + (i)] = 255;
-                }
+    // Each pass visits the edge pixels in raster order and sees the changes of the pixels visited before
+    EdgeBitmap edges(data, step, rows, cols, memory);
 
-                if ((box[14] && !box[7] && !box[10]) && ((box[8] || box[6]) && (box[16] || box[15])))
-                {
-                    edges.data[(edges.cols * (j + 1)) + (i + 1)] = 0;
-                    edges.data[(edges.cols * (j + 1)) + (i - 1)] = 0;
-                    edges.data[(edges.cols * (j + 2)) + (i + 1)] = 0;
-                    edges.data[(edges.cols * (j + 2)) + (i - 1)] = 0;
-                    edges.data[(edges.cols * (j + 1)) + (i)] = 255;
-                    edges.data[(edges.cols * (j + 2)) + (i)] = 255;
-                }
+    // thin edges, too many neighbours
+    for (int pass = 0; pass < 2; pass++)
+    {
+        const std::vector<uchar> &removesCenter = pass == 0 ? isCorner : hasTooManyNeighbours;
+        for (int j = start_y; j < end_y; j++)
+            for (int i = edges.nextEdge(j, start_x, end_x); i < end_x; i = edges.nextEdge(j, i + 1, end_x))
+                if (removesCenter[edges.window3(i, j)])
+                    edges.clear(i, j);
+    }
 
-                if ((box[9] && !box[5]) && (box[8] || box[2]))
+    for (int j = start_y; j < end_y; j++)
+        for (int i = edges.nextEdge(j, start_x, end_x); i < end_x; i = edges.nextEdge(j, i + 1, end_x))
+        {
+            uint64_t window = edges.window7(i, j);
+            uint64_t clear = 0;
+            uint64_t set = 0;
+            for (const EdgePattern &pattern : straighteningPatterns)
+            {
+                if (pattern.matches(window))
                 {
-                    edges.data[(edges.cols * (j + 1)) + (i + 1)] = 0;
-                    edges.data[(edges.cols * (j - 1)) + (i + 1)] = 0;
-                    edges.data[(edges.cols * (j)) + (i + 1)] = 255;
+                    clear |= pattern.clear;
+                    set |= pattern.set;
                 }
+            }
+            edges.clear(clear, i, j);
+            edges.set(set, i, j);
+        }
 
-                if ((box[11] && !box[5] && !box[9]) && ((box[8] || box[2]) && (box[13] || box[12])))
+    for (int j = start_y; j < end_y; j++)
+        for (int i = edges.nextEdge(j, start_x, end_x); i < end_x; i = edges.nextEdge(j, i + 1, end_x))
+        {
+            uint64_t window = edges.window7(i, j);
+            for (const EdgePattern &pattern : removalPatterns)
+            {
+                if (pattern.matches(window))
                 {
-                    edges.data[(edges.cols * (j + 1)) + (i + 1)] = 0;
-                    edges.data[(edges.cols * (j - 1)) + (i + 1)] = 0;
-                    edges.data[(edges.cols * (j + 1)) + (i + 2)] = 0;
-                    edges.data[(edges.cols * (j - 1)) + (i + 2)] = 0;
-                    edges.data[(edges.cols * (j)) + (i + 1)] = 255;
-                    edges.data[(edges.cols * (j)) + (i + 2)] = 255;
+                    edges.clear(i, j);
+                    break;
                 }
             }
         }
 
-    for (int j = start_y; j < end_y; j++)
-        for (int i = start_x; i < end_x; i++)
-        {
+    edges.store(data, step);
+}
 
-            uchar box[33];
+void PuRe::filterEdges(cv::Mat &edges)
+{
+    // edges is the binary (0 or 255) output of canny()
+    filterEdgeBitmap(edges.data, edges.step[0], edges.rows, edges.cols, workspace.edgeBits);
+}
 
-            box[4] = (uchar)edges.data[(edges.cols * (j)) + (i)];
+void PuRe::removeDuplicates(vector<vector<Point>> &curves, const Size &imageSize)
+{
+    // A curve is dropped if its first point belongs to a curve that comes after it (and survived itself).
+    // The points of the surviving curves are flagged in a per pixel map that is kept in the workspace
+    vector<uchar> &pointMap = workspace.curvePointMap;
+    if (pointMap.size() < static_cast<size_t>(imageSize.area()))
+        pointMap.resize(imageSize.area(), 0);
+    vector<uchar> &keep = workspace.keepCurves;
+    keep.assign(curves.size(), 0);
 
-            if (box[4])
-            {
-                box[0] = (uchar)edges.data[(edges.cols * (j - 1)) + (i - 1)];
-                box[1] = (uchar)edges.data[(edges.cols * (j - 1)) + (i)];
-                box[2] = (uchar)edges.data[(edges.cols * (j - 1)) + (i + 1)];
-
-                box[3] = (uchar)edges.data[(edges.cols * (j)) + (i - 1)];
-                box[5] = (uchar)edges.data[(edges.cols * (j)) + (i + 1)];
-
-                box[6] = (uchar)edges.data[(edges.cols * (j + 1)) + (i - 1)];
-                box[7] = (uchar)edges.data[(edges.cols * (j + 1)) + (i)];
-                box[8] = (uchar)edges.data[(edges.cols * (j + 1)) + (i + 1)];
-
-                box[9] = (uchar)edges.data[(edges.cols * (j - 1)) + (i + 2)];
-                box[10] = (uchar)edges.data[(edges.cols * (j - 1)) + (i - 2)];
-                box[11] = (uchar)edges.data[(edges.cols * (j + 1)) + (i + 2)];
-                box[12] = (uchar)edges.data[(edges.cols * (j + 1)) + (i - 2)];
-
-                box[13] = (uchar)edges.data[(edges.cols * (j - 2)) + (i - 1)];
-                box[14] = (uchar)edges.data[(edges.cols * (j - 2)) + (i + 1)];
-                box[15] = (uchar)edges.data[(edges.cols * (j + 2)) + (i - 1)];
-                box[16] = (uchar)edges.data[(edges.cols * (j + 2)) + (i + 1)];
-
-                box[17] = (uchar)edges.data[(edges.cols * (j - 3)) + (i - 1)];
-                box[18] = (uchar)edges.data[(edges.cols * (j - 3)) + (i + 1)];
-                box[19] = (uchar)edges.data[(edges.cols * (j + 3)) + (i - 1)];
-                box[20] = (uchar)edges.data[(edges.cols * (j + 3)) + (i + 1)];
-
-                box[21] = (uchar)edges.data[(edges.cols * (j + 1)) + (i + 3)];
-                box[22] = (uchar)edges.data[(edges.cols * (j + 1)) + (i - 3)];
-                box[23] = (uchar)edges.data[(edges.cols * (j - 1)) + (i + 3)];
-                box[24] = (uchar)edges.data[(edges.cols * (j - 1)) + (i - 3)];
-
-                box[25] = (uchar)edges.data[(edges.cols * (j - 2)) + (i - 2)];
-                box[26] = (uchar)edges.data[(edges.cols * (j + 2)) + (i + 2)];
-                box[27] = (uchar)edges.data[(edges.cols * (j - 2)) + (i + 2)];
-                box[28] = (uchar)edges.data[(edges.cols * (j + 2)) + (i - 2)];
-
-                box[29] = (uchar)edges.data[(edges.cols * (j - 3)) + (i - 3)];
-                box[30] = (uchar)edges.data[(edges.cols * (j + 3)) + (i + 3)];
-                box[31] = (uchar)edges.data[(edges.cols * (j - 3)) + (i + 3)];
-                box[32] = (uchar)edges.data[(edges.cols * (j + 3)) + (i - 3)];
-
-                if (box[7] && box[2] && box[9])
-                    edges.data[(edges.cols * (j)) + (i)] = 0;
-                if (box[7] && box[0] && box[10])
-                    edges.data[(edges.cols * (j)) + (i)] = 0;
-                if (box[1] && box[8] && box[11])
-                    edges.data[(edges.cols * (j)) + (i)] = 0;
-                if (box[1] && box[6] && box[12])
-                    edges.data[(edges.cols * (j)) + (i)] = 0;
-
-                if (box[0] && box[13] && box[17] && box[8] && box[11] && box[21])
-                    edges.data[(edges.cols * (j)) + (i)] = 0;
-                if (box[2] && box[14] && box[18] && box[6] && box[12] && box[22])
-                    edges.data[(edges.cols * (j)) + (i)] = 0;
-                if (box[6] && box[15] && box[19] && box[2] && box[9] && box[23])
-                    edges.data[(edges.cols * (j)) + (i)] = 0;
-                if (box[8] && box[16] && box[20] && box[0] && box[10] && box[24])
-                    edges.data[(edges.cols * (j)) + (i)] = 0;
-
-                if (box[0] && box[25] && box[2] && box[27])
-                    edges.data[(edges.cols * (j)) + (i)] = 0;
-                if (box[0] && box[25] && box[6] && box[28])
-                    edges.data[(edges.cols * (j)) + (i)] = 0;
-                if (box[8] && box[26] && box[2] && box[27])
-                    edges.data[(edges.cols * (j)) + (i)] = 0;
-                if (box[8] && box[26] && box[6] && box[28])
-                    edges.data[(edges.cols * (j)) + (i)] = 0;
-
-                uchar box2[18];
-                box2[1] = (uchar)edges.data[(edges.cols * (j)) + (i - 1)];
-
-                box2[2] = (uchar)edges.data[(edges.cols * (j - 1)) + (i - 2)];
-                box2[3] = (uchar)edges.data[(edges.cols * (j - 2)) + (i - 3)];
-
-                box2[4] = (uchar)edges.data[(edges.cols * (j - 1)) + (i + 1)];
-                box2[5] = (uchar)edges.data[(edges.cols * (j - 2)) + (i + 2)];
-
-                box2[6] = (uchar)edges.data[(edges.cols * (j + 1)) + (i - 2)];
-                box2[7] = (uchar)edges.data[(edges.cols * (j + 2)) + (i - 3)];
-
-                box2[8] = (uchar)edges.data[(edges.cols * (j + 1)) + (i + 1)];
-                box2[9] = (uchar)edges.data[(edges.cols * (j + 2)) + (i + 2)];
-
-                box2[10] = (uchar)edges.data[(edges.cols * (j + 1)) + (i)];
-
-                box2[15] = (uchar)edges.data[(edges.cols * (j - 1)) + (i - 1)];
-                box2[16] = (uchar)edges.data[(edges.cols * (j - 2)) + (i - 2)];
-
-                box2[11] = (uchar)edges.data[(edges.cols * (j + 2)) + (i + 1)];
-                box2[12] = (uchar)edges.data[(edges.cols * (j + 3)) + (i + 2)];
-
-                box2[13] = (uchar)edges.data[(edges.cols * (j + 2)) + (i - 1)];
-                box2[14] = (uchar)edges.data[(edges.cols * (j + 3)) + (i - 2)];
-
-                if (box2[1] && box2[2] && box2[3] && box2[4] && box2[5])
-                    edges.data[(edges.cols * (j)) + (i)] = 0;
-                if (box2[1] && box2[6] && box2[7] && box2[8] && box2[9])
-                    edges.data[(edges.cols * (j)) + (i)] = 0;
-                if (box2[10] && box2[11] && box2[12] && box2[4] && box2[5])
-                    edges.data[(edges.cols * (j)) + (i)] = 0;
-                if (box2[10] && box2[13] && box2[14] && box2[15] && box2[16])
-                    edges.data[(edges.cols * (j)) + (i)] = 0;
-            }
-        }
+    for (size_t i = curves.size(); i-- > 0;)
+    {
+        if (pointMap[pointHash(curves[i][0], imageSize.width)])
+            continue;
+
+        keep[i] = 1;
+        for (size_t j = 0; j < curves[i].size(); j++)
+            pointMap[pointHash(curves[i][j], imageSize.width)] = 1;
+    }
+
+    // compact the surviving curves in their original order and reset the flags they set
+    size_t nrOfKept = 0;
+    for (size_t i = 0; i < curves.size(); i++)
+    {
+        if (!keep[i])
+            continue;
+
+        for (size_t j = 0; j < curves[i].size(); j++)
+            pointMap[pointHash(curves[i][j], imageSize.width)] = 0;
+        if (nrOfKept != i)
+            curves[nrOfKept] = std::move(curves[i]);
+        nrOfKept++;
+    }
+    curves.resize(nrOfKept);
 }
 
 void PuRe::findPupilEdgeCandidates(const Mat &intensityImage, Mat &edge, vector<PupilCandidate> &candidates)
@@ -536,14 +730,14 @@ void PuRe::findPupilEdgeCandidates(const Mat &intensityImage, Mat &edge, vector<
     vector<vector<Point>> curves;
     findContours(edge, curves, hierarchy, CV_RETR_LIST, CV_CHAIN_APPROX_TC89_KCOS);
 
-    removeDuplicates(curves, edge.cols);
+    removeDuplicates(curves, edge.size());
 
     // Create valid candidates
     for (size_t i = curves.size(); i-- > 0;)
     {
-        PupilCandidate candidate(curves[i]);
+        PupilCandidate candidate(std::move(curves[i]));
         if (candidate.isValid(intensityImage, minPupilDiameterPx, maxPupilDiameterPx, outlineBias))
-            candidates.push_back(candidate);
+            candidates.push_back(std::move(candidate));
     }
 }
 
@@ -552,44 +746,73 @@ void PuRe::combineEdgeCandidates(const cv::Mat &intensityImage, cv::Mat &edge, s
     (void)edge;
     if (candidates.size() <= 1)
         return;
+    // Sweep over the combination regions sorted by their left edge to find the pairs that overlap horizontally,
+    // instead of intersecting all pairs. The pairs are then merged in the same order as by a plain pair scan
+    vector<int> &order = workspace.candidateOrder;
+    order.resize(candidates.size());
+    for (size_t i = 0; i < candidates.size(); i++)
+        order[i] = static_cast<int>(i);
+    stable_sort(order.begin(), order.end(), [&candidates](int a, int b) {
+        return candidates[a].combinationRegion.x < candidates[b].combinationRegion.x;
+    });
+
+    vector<pair<int, int>> &pairs = workspace.candidatePairs;
+    pairs.clear();
+    for (size_t s = 0; s < order.size(); s++)
+    {
+        const Rect &region = candidates[order[s]].combinationRegion;
+        for (size_t t = s + 1; t < order.size() && candidates[order[t]].combinationRegion.x < region.x + region.width; t++)
+            pairs.emplace_back(min(order[s], order[t]), max(order[s], order[t]));
+    }
+    sort(pairs.begin(), pairs.end());
+
+    // merged point sets are assembled in the workspace and only handed over to the candidates that survive
+    vector<Point> &mergedPoints = workspace.mergedPoints;
     vector<PupilCandidate> mergedCandidates;
-    for (auto pc = candidates.begin(); pc != candidates.end(); pc++)
+    for (const auto &candidatePair : pairs)
     {
-        for (auto pc2 = pc + 1; pc2 != candidates.end(); pc2++)
-        {
+        auto pc = candidates.begin() + candidatePair.first;
+        auto pc2 = candidates.begin() + candidatePair.second;
 
-            Rect intersection = pc->combinationRegion & pc2->combinationRegion;
-            if (intersection.area() < 1)
-                continue; // no intersection
+        Rect intersection = pc->combinationRegion & pc2->combinationRegion;
+        if (intersection.area() < 1)
+            continue; // no intersection
 //#define DBG_EDGE_COMBINATION
 #ifdef DBG_EDGE_COMBINATION
-            Mat tmp;
-            cvtColor(intensityImage, tmp, CV_GRAY2BGR);
-            rectangle(tmp, pc->combinationRegion, pc->color);
-            for (unsigned int i = 0; i < pc->points.size(); i++)
-                cv::circle(tmp, pc->points[i], 1, pc->color, -1);
-            rectangle(tmp, pc2->combinationRegion, pc2->color);
-            for (unsigned int i = 0; i < pc2->points.size(); i++)
-                cv::circle(tmp, pc2->points[i], 1, pc2->color, -1);
-            imshow("Combined edges", tmp);
-            imwrite("combined.png", tmp);
-            //waitKey(0);
+        Mat tmp;
+        cvtColor(intensityImage, tmp, CV_GRAY2BGR);
+        rectangle(tmp, pc->combinationRegion, pc->color);
+        for (unsigned int i = 0; i < pc->points.size(); i++)
+            cv::circle(tmp, pc->points[i], 1, pc->color, -1);
+        rectangle(tmp, pc2->combinationRegion, pc2->color);
+        for (unsigned int i = 0; i < pc2->points.size(); i++)
+            cv::circle(tmp, pc2->points[i], 1, pc2->color, -1);
+        imshow("Combined edges", tmp);
+        imwrite("combined.png", tmp);
+        //waitKey(0);
 #endif
 
-            if (intersection.area() >= min<int>(pc->combinationRegion.area(), pc2->combinationRegion.area()))
-                continue;
+        if (intersection.area() >= min<int>(pc->combinationRegion.area(), pc2->combinationRegion.area()))
+            continue;
 
-            vector<Point> mergedPoints = pc->points;
-            mergedPoints.insert(mergedPoints.end(), pc2->points.begin(), pc2->points.end());
-            PupilCandidate candidate(mergedPoints);
-            if (!candidate.isValid(intensityImage, minPupilDiameterPx, maxPupilDiameterPx, outlineBias))
-                continue;
-            if (candidate.outlineContrast < pc->outlineContrast || candidate.outlineContrast < pc2->outlineContrast)
-                continue;
-            mergedCandidates.push_back(candidate);
+        mergedPoints.clear();
+        mergedPoints.insert(mergedPoints.end(), pc->points.begin(), pc->points.end());
+        mergedPoints.insert(mergedPoints.end(), pc2->points.begin(), pc2->points.end());
+        PupilCandidate candidate(std::move(mergedPoints));
+        // the hull of the merged points is the hull of both hulls
+        vector<Point> mergedHulls = pc->hull;
+        mergedHulls.insert(mergedHulls.end(), pc2->hull.begin(), pc2->hull.end());
+        convexHull(mergedHulls, candidate.hull);
+        if (!candidate.isValid(intensityImage, minPupilDiameterPx, maxPupilDiameterPx, outlineBias) ||
+            candidate.outlineContrast < pc->outlineContrast || candidate.outlineContrast < pc2->outlineContrast)
+        {
+            // hand the memory back for the next merge
+            mergedPoints = std::move(candidate.points);
+            continue;
         }
+        mergedCandidates.push_back(std::move(candidate));
     }
-    candidates.insert(candidates.end(), mergedCandidates.begin(), mergedCandidates.end());
+    candidates.insert(candidates.end(), make_move_iterator(mergedCandidates.begin()), make_move_iterator(mergedCandidates.end()));
 }
 
 void PuRe::searchInnerCandidates(vector<PupilCandidate> &candidates, PupilCandidate &candidate)
@@ -726,11 +949,7 @@ void PuRe::run(const Mat &frame, Pupil &pupil)
     estimateParameters(workingSize.height, workingSize.width);
 
     // Preallocate stuff for edge detection
-    dx = Mat::zeros(workingSize, CV_32F);
-    dy = Mat::zeros(workingSize, CV_32F);
-    magnitude = Mat::zeros(workingSize, CV_32F);
-    edgeType = Mat::zeros(workingSize, CV_8U);
-    edge = Mat::zeros(workingSize, CV_8U);
+    prepareWorkspace(input.size());
 
     //cvtColor(input, dbg, CV_GRAY2BGR);
     //circle(dbg, Point(0.5*dbg.cols,0.5*dbg.rows), 0.5*minPupilDiameterPx, Scalar(0,0,0), 2);
@@ -774,11 +993,7 @@ void PuRe::run(const cv::Mat &frame, const cv::Rect &roi, Pupil &pupil, const fl
     workingSize.height = input.rows;
 
     // Preallocate stuff for edge detection
-    dx = Mat::zeros(workingSize, CV_32F);
-    dy = Mat::zeros(workingSize, CV_32F);
-    magnitude = Mat::zeros(workingSize, CV_32F);
-    edgeType = Mat::zeros(workingSize, CV_8U);
-    edge = Mat::zeros(workingSize, CV_8U);
+    prepareWorkspace(input.size());
 
     //cvtColor(input, dbg, CV_GRAY2BGR);
     //circle(dbg, Point(0.5*dbg.cols,0.5*dbg.rows), 0.5*minPupilDiameterPx, Scalar(0,0,0), 2);
@@ -799,132 +1014,14 @@ void PuRe::run(const cv::Mat &frame, const cv::Rect &roi, Pupil &pupil, const fl
  *
  ******************************************************************************/
 
-static const float sinTable[] = {
-    0.0000000f, 0.0174524f, 0.0348995f, 0.0523360f, 0.0697565f, 0.0871557f,
-    0.1045285f, 0.1218693f, 0.1391731f, 0.1564345f, 0.1736482f, 0.1908090f,
-    0.2079117f, 0.2249511f, 0.2419219f, 0.2588190f, 0.2756374f, 0.2923717f,
-    0.3090170f, 0.3255682f, 0.3420201f, 0.3583679f, 0.3746066f, 0.3907311f,
-    0.4067366f, 0.4226183f, 0.4383711f, 0.4539905f, 0.4694716f, 0.4848096f,
-    0.5000000f, 0.5150381f, 0.5299193f, 0.5446390f, 0.5591929f, 0.5735764f,
-    0.5877853f, 0.6018150f, 0.6156615f, 0.6293204f, 0.6427876f, 0.6560590f,
-    0.6691306f, 0.6819984f, 0.6946584f, 0.7071068f, 0.7193398f, 0.7313537f,
-    0.7431448f, 0.7547096f, 0.7660444f, 0.7771460f, 0.7880108f, 0.7986355f,
-    0.8090170f, 0.8191520f, 0.8290376f, 0.8386706f, 0.8480481f, 0.8571673f,
-    0.8660254f, 0.8746197f, 0.8829476f, 0.8910065f, 0.8987940f, 0.9063078f,
-    0.9135455f, 0.9205049f, 0.9271839f, 0.9335804f, 0.9396926f, 0.9455186f,
-    0.9510565f, 0.9563048f, 0.9612617f, 0.9659258f, 0.9702957f, 0.9743701f,
-    0.9781476f, 0.9816272f, 0.9848078f, 0.9876883f, 0.9902681f, 0.9925462f,
-    0.9945219f, 0.9961947f, 0.9975641f, 0.9986295f, 0.9993908f, 0.9998477f,
-    1.0000000f, 0.9998477f, 0.9993908f, 0.9986295f, 0.9975641f, 0.9961947f,
-    0.9945219f, 0.9925462f, 0.9902681f, 0.9876883f, 0.9848078f, 0.9816272f,
-    0.9781476f, 0.9743701f, 0.9702957f, 0.9659258f, 0.9612617f, 0.9563048f,
-    0.9510565f, 0.9455186f, 0.9396926f, 0.9335804f, 0.9271839f, 0.9205049f,
-    0.9135455f, 0.9063078f, 0.8987940f, 0.8910065f, 0.8829476f, 0.8746197f,
-    0.8660254f, 0.8571673f, 0.8480481f, 0.8386706f, 0.8290376f, 0.8191520f,
-    0.8090170f, 0.7986355f, 0.7880108f, 0.7771460f, 0.7660444f, 0.7547096f,
-    0.7431448f, 0.7313537f, 0.7193398f, 0.7071068f, 0.6946584f, 0.6819984f,
-    0.6691306f, 0.6560590f, 0.6427876f, 0.6293204f, 0.6156615f, 0.6018150f,
-    0.5877853f, 0.5735764f, 0.5591929f, 0.5446390f, 0.5299193f, 0.5150381f,
-    0.5000000f, 0.4848096f, 0.4694716f, 0.4539905f, 0.4383711f, 0.4226183f,
-    0.4067366f, 0.3907311f, 0.3746066f, 0.3583679f, 0.3420201f, 0.3255682f,
-    0.3090170f, 0.2923717f, 0.2756374f, 0.2588190f, 0.2419219f, 0.2249511f,
-    0.2079117f, 0.1908090f, 0.1736482f, 0.1564345f, 0.1391731f, 0.1218693f,
-    0.1045285f, 0.0871557f, 0.0697565f, 0.0523360f, 0.0348995f, 0.0174524f,
-    0.0000000f, -0.0174524f, -0.0348995f, -0.0523360f, -0.0697565f, -0.0871557f,
-    -0.1045285f, -0.1218693f, -0.1391731f, -0.1564345f, -0.1736482f, -0.1908090f,
-    -0.2079117f, -0.2249511f, -0.2419219f, -0.2588190f, -0.2756374f, -0.2923717f,
-    -0.3090170f, -0.3255682f, -0.3420201f, -0.3583679f, -0.3746066f, -0.3907311f,
-    -0.4067366f, -0.4226183f, -0.4383711f, -0.4539905f, -0.4694716f, -0.4848096f,
-    -0.5000000f, -0.5150381f, -0.5299193f, -0.5446390f, -0.5591929f, -0.5735764f,
-    -0.5877853f, -0.6018150f, -0.6156615f, -0.6293204f, -0.6427876f, -0.6560590f,
-    -0.6691306f, -0.6819984f, -0.6946584f, -0.7071068f, -0.7193398f, -0.7313537f,
-    -0.7431448f, -0.7547096f, -0.7660444f, -0.7771460f, -0.7880108f, -0.7986355f,
-    -0.8090170f, -0.8191520f, -0.8290376f, -0.8386706f, -0.8480481f, -0.8571673f,
-    -0.8660254f, -0.8746197f, -0.8829476f, -0.8910065f, -0.8987940f, -0.9063078f,
-    -0.9135455f, -0.9205049f, -0.9271839f, -0.9335804f, -0.9396926f, -0.9455186f,
-    -0.9510565f, -0.9563048f, -0.9612617f, -0.9659258f, -0.9702957f, -0.9743701f,
-    -0.9781476f, -0.9816272f, -0.9848078f, -0.9876883f, -0.9902681f, -0.9925462f,
-    -0.9945219f, -0.9961947f, -0.9975641f, -0.9986295f, -0.9993908f, -0.9998477f,
-    -1.0000000f, -0.9998477f, -0.9993908f, -0.9986295f, -0.9975641f, -0.9961947f,
-    -0.9945219f, -0.9925462f, -0.9902681f, -0.9876883f, -0.9848078f, -0.9816272f,
-    -0.9781476f, -0.9743701f, -0.9702957f, -0.9659258f, -0.9612617f, -0.9563048f,
-    -0.9510565f, -0.9455186f, -0.9396926f, -0.9335804f, -0.9271839f, -0.9205049f,
-    -0.9135455f, -0.9063078f, -0.8987940f, -0.8910065f, -0.8829476f, -0.8746197f,
-    -0.8660254f, -0.8571673f, -0.8480481f, -0.8386706f, -0.8290376f, -0.8191520f,
-    -0.8090170f, -0.7986355f, -0.7880108f, -0.7771460f, -0.7660444f, -0.7547096f,
-    -0.7431448f, -0.7313537f, -0.7193398f, -0.7071068f, -0.6946584f, -0.6819984f,
-    -0.6691306f, -0.6560590f, -0.6427876f, -0.6293204f, -0.6156615f, -0.6018150f,
-    -0.5877853f, -0.5735764f, -0.5591929f, -0.5446390f, -0.5299193f, -0.5150381f,
-    -0.5000000f, -0.4848096f, -0.4694716f, -0.4539905f, -0.4383711f, -0.4226183f,
-    -0.4067366f, -0.3907311f, -0.3746066f, -0.3583679f, -0.3420201f, -0.3255682f,
-    -0.3090170f, -0.2923717f, -0.2756374f, -0.2588190f, -0.2419219f, -0.2249511f,
-    -0.2079117f, -0.1908090f, -0.1736482f, -0.1564345f, -0.1391731f, -0.1218693f,
-    -0.1045285f, -0.0871557f, -0.0697565f, -0.0523360f, -0.0348995f, -0.0174524f,
-    -0.0000000f, 0.0174524f, 0.0348995f, 0.0523360f, 0.0697565f, 0.0871557f,
-    0.1045285f, 0.1218693f, 0.1391731f, 0.1564345f, 0.1736482f, 0.1908090f,
-    0.2079117f, 0.2249511f, 0.2419219f, 0.2588190f, 0.2756374f, 0.2923717f,
-    0.3090170f, 0.3255682f, 0.3420201f, 0.3583679f, 0.3746066f, 0.3907311f,
-    0.4067366f, 0.4226183f, 0.4383711f, 0.4539905f, 0.4694716f, 0.4848096f,
-    0.5000000f, 0.5150381f, 0.5299193f, 0.5446390f, 0.5591929f, 0.5735764f,
-    0.5877853f, 0.6018150f, 0.6156615f, 0.6293204f, 0.6427876f, 0.6560590f,
-    0.6691306f, 0.6819984f, 0.6946584f, 0.7071068f, 0.7193398f, 0.7313537f,
-    0.7431448f, 0.7547096f, 0.7660444f, 0.7771460f, 0.7880108f, 0.7986355f,
-    0.8090170f, 0.8191520f, 0.8290376f, 0.8386706f, 0.8480481f, 0.8571673f,
-    0.8660254f, 0.8746197f, 0.8829476f, 0.8910065f, 0.8987940f, 0.9063078f,
-    0.9135455f, 0.9205049f, 0.9271839f, 0.9335804f, 0.9396926f, 0.9455186f,
-    0.9510565f, 0.9563048f, 0.9612617f, 0.9659258f, 0.9702957f, 0.9743701f,
-    0.9781476f, 0.9816272f, 0.9848078f, 0.9876883f, 0.9902681f, 0.9925462f,
-    0.9945219f, 0.9961947f, 0.9975641f, 0.9986295f, 0.9993908f, 0.9998477f,
-    1.0000000f};
-
-static void inline sincos(int angle, float &cosval, float &sinval)
-{
-    angle += (angle < 0 ? 360 : 0);
-    sinval = sinTable[angle];
-    cosval = sinTable[450 - angle];
-}
-
-static inline vector<Point> ellipse2Points(const RotatedRect &ellipse, const int &delta)
-{
-    int angle = ellipse.angle;
-
-    // make sure angle is within range
-    while (angle < 0)
-        angle += 360;
-    while (angle > 360)
-        angle -= 360;
-
-    float alpha, beta;
-    sincos(angle, alpha, beta);
-
-    double x, y;
-    vector<Point> points;
-    for (int i = 0; i < 360; i += delta)
-    {
-        x = 0.5 * ellipse.size.width * sinTable[450 - i];
-        y = 0.5 * ellipse.size.height * sinTable[i];
-        points.push_back(
-            Point(roundf(ellipse.center.x + x * alpha - y * beta),
-                  roundf(ellipse.center.y + x * beta + y * alpha)));
-    }
-    return points;
-}
-
 inline bool PupilCandidate::isValid(const cv::Mat &intensityImage, const int &minPupilDiameterPx, const int &maxPupilDiameterPx, const int bias)
 {
     if (points.size() < 5)
         return false;
 
-    float maxGap = 0;
-    for (auto p1 = points.begin(); p1 != points.end(); p1++)
-    {
-        for (auto p2 = p1 + 1; p2 != points.end(); p2++)
-        {
-            float gap = norm(*p2 - *p1);
-            if (gap > maxGap)
-                maxGap = gap;
-        }
-    }
+    if (hull.empty())
+        convexHull(points, hull);
+    float maxGap = PupilDetectionMethod::convexHullDiameter(hull);
 
     if (maxGap >= maxPupilDiameterPx)
         return false;
@@ -974,148 +1071,10 @@ inline bool PupilCandidate::fastValidityCheck(const int &maxPupilDiameterPx)
 inline bool PupilCandidate::validateOutlineContrast(const Mat &intensityImage, const int &bias)
 {
     int delta = 0.15 * minorAxis;
-    cv::Point c = outline.center;
-//#define DBG_OUTLINE_CONTRAST
-#ifdef DBG_OUTLINE_CONTRAST
-    cv::Mat tmp;
-    cv::cvtColor(intensityImage, tmp, CV_GRAY2BGR);
-    cv::ellipse(tmp, outline, cv::Scalar(0, 255, 255));
-    cv::Scalar lineColor;
-#endif
-    int evaluated = 0;
-    int validCount = 0;
-
-    vector<Point> outlinePoints = ellipse2Points(outline, 10);
-    for (auto p = outlinePoints.begin(); p != outlinePoints.end(); p++)
-    {
-        int dx = p->x - c.x;
-        int dy = p->y - c.y;
-
-        float a = 0;
-        if (dx != 0)
-            a = dy / (float)dx;
-        float b = c.y - a * c.x;
-
-        if (a == 0)
-            continue;
-
-        if (abs(dx) > abs(dy))
-        {
-            int sx = p->x - delta;
-            int ex = p->x + delta;
-            int sy = std::roundf(a * sx + b);
-            int ey = std::roundf(a * ex + b);
-            cv::Point start = {sx, sy};
-            cv::Point end = {ex, ey};
-            evaluated++;
-
-            if (!boundaries.contains(start) || !boundaries.contains(end))
-                continue;
-
-            float m1, m2, count;
-
-            m1 = count = 0;
-            for (int x = sx; x < p->x; x++)
-                m1 += intensityImage.ptr<uchar>((int)std::roundf(a * x + b))[x];
-            m1 = std::roundf(m1 / delta);
-
-            m2 = count = 0;
-            for (int x = p->x + 1; x <= ex; x++)
-            {
-                m2 += intensityImage.ptr<uchar>((int)std::roundf(a * x + b))[x];
-            }
-            m2 = std::roundf(m2 / delta);
-
-#ifdef DBG_OUTLINE_CONTRAST
-            lineColor = cv::Scalar(0, 0, 255);
-#endif
-            if (p->x < c.x)
-            { // leftwise point
-                if (m1 > m2 + bias)
-                {
-                    validCount++;
-#ifdef DBG_OUTLINE_CONTRAST
-                    lineColor = cv::Scalar(0, 255, 0);
-#endif
-                }
-            }
-            else
-            { // rightwise point
-                if (m2 > m1 + bias)
-                {
-                    validCount++;
-#ifdef DBG_OUTLINE_CONTRAST
-                    lineColor = cv::Scalar(0, 255, 0);
-#endif
-                }
-            }
-
-#ifdef DBG_OUTLINE_CONTRAST
-            cv::line(tmp, start, end, lineColor);
-#endif
-        }
-        else
-        {
-            int sy = p->y - delta;
-            int ey = p->y + delta;
-            int sx = std::roundf((sy - b) / a);
-            int ex = std::roundf((ey - b) / a);
-            cv::Point start = {sx, sy};
-            cv::Point end = {ex, ey};
-
-            evaluated++;
-            if (!boundaries.contains(start) || !boundaries.contains(end))
-                continue;
-
-            float m1, m2, count;
-
-            m1 = count = 0;
-            for (int y = sy; y < p->y; y++)
-                m1 += intensityImage.ptr<uchar>(y)[(int)std::roundf((y - b) / a)];
-            m1 = std::roundf(m1 / delta);
-
-            m2 = count = 0;
-            for (int y = p->y + 1; y <= ey; y++)
-                m2 += intensityImage.ptr<uchar>(y)[(int)std::roundf((y - b) / a)];
-            m2 = std::roundf(m2 / delta);
-
-#ifdef DBG_OUTLINE_CONTRAST
-            lineColor = cv::Scalar(0, 0, 255);
-#endif
-            if (p->y < c.y)
-            { // upperwise point
-                if (m1 > m2 + bias)
-                {
-                    validCount++;
-#ifdef DBG_OUTLINE_CONTRAST
-                    lineColor = cv::Scalar(0, 255, 0);
-#endif
-                }
-            }
-            else
-            { // bottomwise point
-                if (m2 > m1 + bias)
-                {
-                    validCount++;
-#ifdef DBG_OUTLINE_CONTRAST
-                    lineColor = cv::Scalar(0, 255, 0);
-#endif
-                }
-            }
-
-#ifdef DBG_OUTLINE_CONTRAST
-            cv::line(tmp, start, end, lineColor);
-#endif
-        }
-    }
-    if (evaluated == 0)
+    float ratio = PupilDetectionMethod::outlineContrastRatio(intensityImage, outline, delta, bias);
+    if (ratio < 0)
         return false;
-    outlineContrast = validCount / (float)evaluated;
-#ifdef DBG_OUTLINE_CONTRAST
-    cv::imshow("Outline Contrast", tmp);
-    cv::waitKey(0);
-#endif
-
+    outlineContrast = ratio;
     return true;
 }
 
@@ -1165,127 +1124,12 @@ inline bool PupilCandidate::validityCheck(const cv::Mat &intensityImage, const i
 
 inline bool PupilCandidate::drawOutlineContrast(const Mat &intensityImage, const int &bias, const std::string &out)
 {
-    double lw = 1;
     int delta = 0.15 * minorAxis;
-    cv::Point c = outline.center;
     cv::Mat tmp;
-    cv::cvtColor(intensityImage, tmp, CV_GRAY2BGR);
-    cv::ellipse(tmp, outline, cv::Scalar(0, 255, 255), lw);
-    cv::Scalar lineColor;
-
-    int evaluated = 0;
-    int validCount = 0;
-
-    vector<Point> outlinePoints = ellipse2Points(outline, 10);
-    for (auto p = outlinePoints.begin(); p != outlinePoints.end(); p++)
-    {
-        int dx = p->x - c.x;
-        int dy = p->y - c.y;
-
-        float a = 0;
-        if (dx != 0)
-            a = dy / (float)dx;
-        float b = c.y - a * c.x;
-
-        if (a == 0)
-            continue;
-
-        if (abs(dx) > abs(dy))
-        {
-            int sx = p->x - delta;
-            int ex = p->x + delta;
-            int sy = std::roundf(a * sx + b);
-            int ey = std::roundf(a * ex + b);
-            cv::Point start = {sx, sy};
-            cv::Point end = {ex, ey};
-            evaluated++;
-
-            if (!boundaries.contains(start) || !boundaries.contains(end))
-                continue;
-
-            float m1, m2, count;
-
-            m1 = count = 0;
-            for (int x = sx; x < p->x; x++)
-                m1 += intensityImage.ptr<uchar>((int)std::roundf(a * x + b))[x];
-            m1 = std::roundf(m1 / delta);
-
-            m2 = count = 0;
-            for (int x = p->x + 1; x <= ex; x++)
-            {
-                m2 += intensityImage.ptr<uchar>((int)std::roundf(a * x + b))[x];
-            }
-            m2 = std::roundf(m2 / delta);
-
-            lineColor = cv::Scalar(0, 0, 255);
-            if (p->x < c.x)
-            { // leftwise point
-                if (m1 > m2 + bias)
-                {
-                    validCount++;
-                    lineColor = cv::Scalar(0, 255, 0);
-                }
-            }
-            else
-            { // rightwise point
-                if (m2 > m1 + bias)
-                {
-                    validCount++;
-                    lineColor = cv::Scalar(0, 255, 0);
-                }
-            }
-
-            cv::line(tmp, start, end, lineColor, lw);
-        }
-        else
-        {
-            int sy = p->y - delta;
-            int ey = p->y + delta;
-            int sx = std::roundf((sy - b) / a);
-            int ex = std::roundf((ey - b) / a);
-            cv::Point start = {sx, sy};
-            cv::Point end = {ex, ey};
-
-            evaluated++;
-            if (!boundaries.contains(start) || !boundaries.contains(end))
-                continue;
-
-            float m1, m2, count;
-
-            m1 = count = 0;
-            for (int y = sy; y < p->y; y++)
-                m1 += intensityImage.ptr<uchar>(y)[(int)std::roundf((y - b) / a)];
-            m1 = std::roundf(m1 / delta);
-
-            m2 = count = 0;
-            for (int y = p->y + 1; y <= ey; y++)
-                m2 += intensityImage.ptr<uchar>(y)[(int)std::roundf((y - b) / a)];
-            m2 = std::roundf(m2 / delta);
-
-            lineColor = cv::Scalar(0, 0, 255);
-            if (p->y < c.y)
-            { // upperwise point
-                if (m1 > m2 + bias)
-                {
-                    validCount++;
-                    lineColor = cv::Scalar(0, 255, 0);
-                }
-            }
-            else
-            { // bottomwise point
-                if (m2 > m1 + bias)
-                {
-                    validCount++;
-                    lineColor = cv::Scalar(0, 255, 0);
-                }
-            }
-
-            cv::line(tmp, start, end, lineColor, lw);
-        }
-    }
-    if (evaluated == 0)
+    float ratio = PupilDetectionMethod::outlineContrastRatio(intensityImage, outline, delta, bias, &tmp);
+    if (ratio < 0)
         return false;
-    outlineContrast = validCount / (float)evaluated;
+    outlineContrast = ratio;
     cv::imwrite(out, tmp);
 
     return true;
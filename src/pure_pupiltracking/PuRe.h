@@ -40,9 +40,11 @@
 #define PURE_H
 
 #include <bitset>
+#include <cstdint>
 #include <random>
 #include <string>
-#include <map>
+#include <utility>
+#include <vector>
 
 #include "mediapipe/framework/port/opencv_highgui_inc.h"
 #include "mediapipe/framework/port/opencv_imgproc_inc.h"
@@ -54,6 +56,7 @@ class PupilCandidate
 {
 public:
     std::vector<cv::Point> points;
+    std::vector<cv::Point> hull; // convex hull of points, computed by isValid() unless it was set beforehand
     cv::RotatedRect pointsMinAreaRect;
     float minCurvatureRatio;
 
@@ -94,7 +97,7 @@ public:
                                                     score(0.0f),
                                                     color(0, 255, 0)
     {
-        this->points = points;
+        this->points = std::move(points);
     }
     bool isValid(const cv::Mat &intensityImage, const int &minPupilDiameterPx, const int &maxPupilDiameterPx, const int bias = 5);
     void estimateOutline();
@@ -163,6 +166,54 @@ public:
     }
 };
 
+/*
+ * Scratch memory of the edge detection and candidate search that is kept across frames.
+ * A buffer is only reallocated when a frame needs more memory than it already holds;
+ * the matrices handed out are continuous views into that memory and stay valid until the buffer is requested again.
+ */
+class PuReWorkspace
+{
+public:
+    enum Buffer
+    {
+        DX = 0,
+        DY,
+        MAGNITUDE,
+        EDGE_TYPE,
+        EDGE,
+        BLURRED,
+        DX_16S,
+        DY_16S,
+        OUTLINE_EDGES,
+        NR_OF_BUFFERS
+    };
+
+    cv::Mat get(Buffer buffer, const cv::Size &size, int type)
+    {
+        size_t bytes = static_cast<size_t>(size.area()) * CV_ELEM_SIZE(type);
+        if (bytes == 0)
+            return cv::Mat(size, type);
+
+        cv::Mat &memory = buffers[buffer];
+        if (memory.total() < bytes)
+            memory.create(1, static_cast<int>(bytes), CV_8U);
+        return cv::Mat(size, type, memory.data);
+    }
+
+    std::vector<int> hysteresisStack;
+    std::vector<uchar> curvePointMap; // one flag per pixel, all zero between calls of removeDuplicates
+    std::vector<uchar> keepCurves;
+    std::vector<uint64_t> edgeBits; // bitmap of the edges for filterEdges, one bit per pixel
+
+    // Candidate merging
+    std::vector<int> candidateOrder;
+    std::vector<std::pair<int, int>> candidatePairs;
+    std::vector<cv::Point> mergedPoints;
+
+private:
+    cv::Mat buffers[NR_OF_BUFFERS];
+};
+
 class PuRe : public PupilDetectionMethod
 {
 public:
@@ -183,12 +234,29 @@ public:
     bool hasCoarseLocation() { return false; }
     static std::string desc;
 
+    /*
+     * Gradients of the edge detection:
+     * REFERENCE_GRADIENT blurs and applies 7x7 Sobel kernels in float, as in the original implementation.
+     * FAST_GRADIENT folds the smoothing of both into one fixed-point blur and computes dx and dy together
+     * with a 3x3 Sobel in 16 bit integers. It is several times faster, but only approximates the reference.
+     */
+    enum GradientMode
+    {
+        REFERENCE_GRADIENT,
+        FAST_GRADIENT
+    };
+    void setGradientMode(GradientMode mode) { gradientMode = mode; }
+
     float meanCanthiDistanceMM;
     float maxPupilDiameterMM;
     float minPupilDiameterMM;
     float meanIrisDiameterMM;
 
 protected:
+    friend class PuReBenchmark; // times the single stages of detect(), see PuReBenchmarks.cc
+    friend class PuReCannyTest;       // compares canny() with the original implementation, see PuReCannyTest.cc
+    friend class PuReFilterEdgesTest; // compares filterEdges() with the original implementation, see PuReFilterEdgesTest.cc
+
     cv::RotatedRect detectedPupil;
     cv::Size expectedFrameSize;
 
@@ -215,8 +283,13 @@ protected:
     void detect(Pupil &pupil);
 
     // Canny
+    PuReWorkspace workspace;
+    void prepareWorkspace(const cv::Size &size);
     cv::Mat dx, dy, magnitude;
     cv::Mat edgeType, edge;
+    GradientMode gradientMode;
+    float lowThreshold, highThreshold; // hysteresis thresholds of the last canny(), on the scale of magnitude
+    void fastGradients(const cv::Mat &in, bool blur);
     cv::Mat canny(const cv::Mat &in, bool blur = true, bool useL2 = true, int bins = 64, float nonEdgePixelsRatio = 0.7f, float lowHighThresholdRatio = 0.4f);
 
     // Edge filtering
@@ -224,20 +297,7 @@ protected:
 
     // Remove duplicates (e.g., from closed loops)
     int pointHash(cv::Point p, int cols) { return p.y * cols + p.x; }
-    void removeDuplicates(std::vector<std::vector<cv::Point>> &curves, const int &cols)
-    {
-        std::map<int, uchar> contourMap;
-        for (size_t i = curves.size(); i-- > 0;)
-        {
-            if (contourMap.count(pointHash(curves[i][0], cols)) > 0)
-                curves.erase(curves.begin() + i);
-            else
-            {
-                for (int j = 0; j < curves[i].size(); j++)
-                    contourMap[pointHash(curves[i][j], cols)] = 1;
-            }
-        }
-    }
+    void removeDuplicates(std::vector<std::vector<cv::Point>> &curves, const cv::Size &imageSize);
 
     void findPupilEdgeCandidates(const cv::Mat &intensityImage, cv::Mat &edge, std::vector<PupilCandidate> &candidates);
     void combineEdgeCandidates(const cv::Mat &intensityImage, cv::Mat &edge, std::vector<PupilCandidate> &candidates);
@@ -0,0 +1,270 @@
+/*
+ * Benchmarks of the stages of PuRe and PuReST.
+ *
+ * Times canny(), filterEdges(), findPupilEdgeCandidates() and combineEdgeCandidates() of PuRe, greedySearch() and
+ * trackOutline() of PuReST and a full PupilTrackingMethod::track() on a set of eye crops.
+ * Without arguments the crops are rendered at several resolutions, so every machine benchmarks the same pixels.
+ * Any other eye crops (images) can be passed instead.
+ *
+ * Usage: pure_benchmarks [--benchmark_filter=<regex>] [--benchmark_format=<console|json|csv>] [<eye crop> ...]
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+
+#include "PuRe.h"
+#include "PuReST.h"
+#include "src/util/hcmsyntheticeyevideo.h"
+#include "mediapipe/framework/port/opencv_highgui_inc.h"
+#include "mediapipe/framework/port/opencv_imgproc_inc.h"
+
+/*
+ * Runs the stages of PuRe and PuReST one by one. Sets them up exactly like PuRe::run() and PuReST::run() do.
+ */
+class PuReBenchmark
+{
+public:
+    // everything PuRe::run() does before detect()
+    static void prepareDetection(PuRe &pure, const cv::Mat &frame)
+    {
+        pure.init(frame);
+
+        cv::Mat downscaled;
+        cv::resize(frame, downscaled, cv::Size(), pure.scalingRatio, pure.scalingRatio, cv::INTER_LINEAR);
+        cv::normalize(downscaled, pure.input, 0, 255, cv::NORM_MINMAX, CV_8U);
+
+        pure.workingSize.width = floor(pure.scalingRatio * frame.cols);
+        pure.workingSize.height = floor(pure.scalingRatio * frame.rows);
+        pure.estimateParameters(pure.workingSize.height, pure.workingSize.width);
+        pure.prepareWorkspace(pure.input.size());
+    }
+
+    static cv::Mat canny(PuRe &pure) { return pure.canny(pure.input, true, true, 64, 0.7f, 0.4f); }
+    static void filterEdges(PuRe &pure, cv::Mat &edges) { pure.filterEdges(edges); }
+    static void findPupilEdgeCandidates(PuRe &pure, cv::Mat &edges, std::vector<PupilCandidate> &candidates) { pure.findPupilEdgeCandidates(pure.input, edges, candidates); }
+    static void combineEdgeCandidates(PuRe &pure, cv::Mat &edges, std::vector<PupilCandidate> &candidates) { pure.combineEdgeCandidates(pure.input, edges, candidates); }
+
+    // the inputs of PuReST's trackers for one frame
+    struct Tracking
+    {
+        Pupil basePupil;
+        cv::Mat dark, bright;
+        cv::Mat edges, outlineEdges;
+        float localScalingRatio;
+    };
+
+    // everything PuReST::run() does before trackOutline() and greedySearch()
+    static bool prepareTracking(PuReST &purest, const cv::Mat &frame, const Pupil &previousPupil, Tracking &tracking)
+    {
+        purest.baseSize = {frame.cols, frame.rows};
+        purest.init(frame);
+
+        cv::Rect frameRect = {0, 0, frame.cols, frame.rows};
+        double trackingRectHalfSide = std::max<int>(previousPupil.size.width, previousPupil.size.height);
+        cv::Point2f delta(trackingRectHalfSide, trackingRectHalfSide);
+        cv::Rect trackingRect = cv::Rect(previousPupil.center - delta, previousPupil.center + delta);
+        trackingRect &= frameRect;
+        if (trackingRect.width < 10 || trackingRect.height < 10)
+            return false;
+
+        tracking.localScalingRatio = purest.scalingRatio;
+        cv::Size scaledSize = trackingRect.size();
+        scaledSize.width *= purest.scalingRatio;
+        scaledSize.height *= purest.scalingRatio;
+        cv::Size2f maxSize = {100.f, 100.f};
+        if (scaledSize.width > maxSize.width || scaledSize.height > maxSize.height)
+            tracking.localScalingRatio = std::min<float>(maxSize.width / trackingRect.width, maxSize.height / trackingRect.height);
+
+        purest.estimateParameters(tracking.localScalingRatio * frame.rows, tracking.localScalingRatio * frame.cols);
+
+        cv::resize(frame(trackingRect), purest.input, cv::Size(), tracking.localScalingRatio, tracking.localScalingRatio, cv::INTER_LINEAR);
+        purest.workingSize = {purest.input.cols, purest.input.rows};
+        purest.prepareWorkspace(purest.workingSize);
+
+        tracking.basePupil = previousPupil;
+        tracking.basePupil.shift(-cv::Point2f(trackingRect.tl()));
+        tracking.basePupil.resize(tracking.localScalingRatio);
+
+        cv::Mat histogram;
+        purest.calculateHistogram(purest.input, histogram, 256);
+        int lowTh, highTh;
+        purest.getThresholds(purest.input, histogram, tracking.basePupil, lowTh, highTh, tracking.bright, tracking.dark);
+
+        // copies, as the workspace of purest is reused by the next canny()
+        tracking.edges = purest.canny(purest.input, true, true, 64, 0.7f, 0.4f).clone();
+        purest.filterEdges(tracking.edges);
+        tracking.outlineEdges = tracking.edges.clone();
+        tracking.outlineEdges.setTo(0, tracking.bright != 0);
+        tracking.outlineEdges.setTo(0, tracking.dark != 255);
+        return true;
+    }
+
+    static bool trackOutline(PuReST &purest, const Tracking &tracking, Pupil &pupil)
+    {
+        return purest.trackOutline(tracking.outlineEdges, tracking.basePupil, pupil, tracking.localScalingRatio);
+    }
+
+    static bool greedySearch(PuReST &purest, const Tracking &tracking, Pupil &pupil)
+    {
+        return purest.greedySearch(tracking.edges, tracking.basePupil, tracking.dark, tracking.bright, pupil, tracking.localScalingRatio * purest.minPupilDiameterPx);
+    }
+};
+
+static void benchmarkCanny(benchmark::State &state, cv::Mat crop)
+{
+    PuRe pure;
+    PuReBenchmark::prepareDetection(pure, crop);
+    for (auto _ : state)
+        benchmark::DoNotOptimize(PuReBenchmark::canny(pure).data);
+}
+
+static void benchmarkFilterEdges(benchmark::State &state, cv::Mat crop)
+{
+    PuRe pure;
+    PuReBenchmark::prepareDetection(pure, crop);
+    cv::Mat cannyEdges = PuReBenchmark::canny(pure).clone();
+    cv::Mat edges;
+    for (auto _ : state)
+    {
+        state.PauseTiming();
+        cannyEdges.copyTo(edges);
+        state.ResumeTiming();
+        PuReBenchmark::filterEdges(pure, edges);
+    }
+}
+
+static void benchmarkFindPupilEdgeCandidates(benchmark::State &state, cv::Mat crop)
+{
+    PuRe pure;
+    PuReBenchmark::prepareDetection(pure, crop);
+    cv::Mat edges = PuReBenchmark::canny(pure).clone();
+    PuReBenchmark::filterEdges(pure, edges);
+    std::vector<PupilCandidate> candidates;
+    for (auto _ : state)
+    {
+        candidates.clear();
+        PuReBenchmark::findPupilEdgeCandidates(pure, edges, candidates);
+    }
+    state.counters["candidates"] = candidates.size();
+}
+
+static void benchmarkCombineEdgeCandidates(benchmark::State &state, cv::Mat crop)
+{
+    PuRe pure;
+    PuReBenchmark::prepareDetection(pure, crop);
+    cv::Mat edges = PuReBenchmark::canny(pure).clone();
+    PuReBenchmark::filterEdges(pure, edges);
+    std::vector<PupilCandidate> foundCandidates, candidates;
+    PuReBenchmark::findPupilEdgeCandidates(pure, edges, foundCandidates);
+    for (auto _ : state)
+    {
+        state.PauseTiming();
+        candidates = foundCandidates;
+        state.ResumeTiming();
+        PuReBenchmark::combineEdgeCandidates(pure, edges, candidates);
+    }
+    state.counters["candidates"] = foundCandidates.size();
+}
+
+// the pupil PuReST tracks from, as found by a detection on the crop
+static bool detectPreviousPupil(const cv::Mat &crop, Pupil &pupil)
+{
+    PuRe pure;
+    pure.run(crop, pupil);
+    return pupil.valid();
+}
+
+static void benchmarkTrackOutline(benchmark::State &state, cv::Mat crop)
+{
+    Pupil previousPupil, pupil;
+    PuReST purest;
+    PuReBenchmark::Tracking tracking;
+    if (!detectPreviousPupil(crop, previousPupil) || !PuReBenchmark::prepareTracking(purest, crop, previousPupil, tracking))
+    {
+        state.SkipWithError("no pupil to track");
+        return;
+    }
+    for (auto _ : state)
+        benchmark::DoNotOptimize(PuReBenchmark::trackOutline(purest, tracking, pupil));
+}
+
+static void benchmarkGreedySearch(benchmark::State &state, cv::Mat crop)
+{
+    Pupil previousPupil, pupil;
+    PuReST purest;
+    PuReBenchmark::Tracking tracking;
+    if (!detectPreviousPupil(crop, previousPupil) || !PuReBenchmark::prepareTracking(purest, crop, previousPupil, tracking))
+    {
+        state.SkipWithError("no pupil to track");
+        return;
+    }
+    for (auto _ : state)
+        benchmark::DoNotOptimize(PuReBenchmark::greedySearch(purest, tracking, pupil));
+}
+
+static void benchmarkDetection(benchmark::State &state, cv::Mat crop)
+{
+    PuRe pure;
+    Pupil pupil;
+    for (auto _ : state)
+        pure.run(crop, pupil);
+}
+
+// detection on the first frame, tracking on all following ones, like HCMLabPupilDetector::process()
+static void benchmarkTrack(benchmark::State &state, cv::Mat crop)
+{
+    PuRe pure;
+    PuReST purest;
+    Pupil pupil;
+    Timestamp ts = 0;
+    cv::Rect roi(0, 0, crop.cols, crop.rows);
+    for (auto _ : state)
+        purest.track(ts++, crop, roi, pupil, pure);
+}
+
+static void registerBenchmarks(const std::string &cropName, const cv::Mat &crop)
+{
+    benchmark::RegisterBenchmark(("PuRe::canny/" + cropName).c_str(), benchmarkCanny, crop);
+    benchmark::RegisterBenchmark(("PuRe::filterEdges/" + cropName).c_str(), benchmarkFilterEdges, crop);
+    benchmark::RegisterBenchmark(("PuRe::findPupilEdgeCandidates/" + cropName).c_str(), benchmarkFindPupilEdgeCandidates, crop);
+    benchmark::RegisterBenchmark(("PuRe::combineEdgeCandidates/" + cropName).c_str(), benchmarkCombineEdgeCandidates, crop);
+    benchmark::RegisterBenchmark(("PuRe::run/" + cropName).c_str(), benchmarkDetection, crop);
+    benchmark::RegisterBenchmark(("PuReST::trackOutline/" + cropName).c_str(), benchmarkTrackOutline, crop);
+    benchmark::RegisterBenchmark(("PuReST::greedySearch/" + cropName).c_str(), benchmarkGreedySearch, crop);
+    benchmark::RegisterBenchmark(("PupilTrackingMethod::track/" + cropName).c_str(), benchmarkTrack, crop);
+}
+
+int main(int argc, char **argv)
+{
+    // removes the --benchmark_* flags, all remaining arguments are eye crops
+    benchmark::Initialize(&argc, argv);
+
+    std::vector<std::pair<std::string, cv::Mat>> crops;
+    for (int i = 1; i < argc; i++)
+    {
+        cv::Mat crop = cv::imread(argv[i], cv::IMREAD_GRAYSCALE);
+        if (crop.empty())
+        {
+            std::cerr << "Could not read " << argv[i] << "\n";
+            return 1;
+        }
+        crops.emplace_back(argv[i], crop);
+    }
+    if (crops.empty())
+    {
+        for (const cv::Size &size : {cv::Size(80, 60), cv::Size(160, 120), cv::Size(320, 240), cv::Size(640, 480)})
+            crops.emplace_back("synthetic_" + std::to_string(size.width) + "x" + std::to_string(size.height), renderSyntheticEyeCrop(size, 42));
+    }
+
+    for (const auto &crop : crops)
+        registerBenchmarks(crop.first, crop.second);
+
+    benchmark::RunSpecifiedBenchmarks();
+    return 0;
+}
@@ -0,0 +1,243 @@
+/*
+ * Checks that PuRe::canny() finds exactly the edges of the original implementation.
+ *
+ * The vectorized non maximum suppression and the stack based hysteresis of canny() are compared with the original
+ * scalar non maximum suppression and breadth-first hysteresis, which run on the derivatives, the magnitude and the
+ * thresholds of the same canny() call. The inputs cover widths that are no multiple of the 16 pixels the SIMD code
+ * handles at once, clipped (saturated) areas and areas without any gradient.
+ */
+
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "PuRe.h"
+#include "mediapipe/framework/port/opencv_imgproc_inc.h"
+#include "src/util/hcmsyntheticeyevideo.h"
+
+/*
+ * Runs canny() of a PuRe the way PuRe::run() does and keeps copies of everything it computed
+ */
+class PuReCannyTest : public ::testing::Test
+{
+public:
+    struct Canny
+    {
+        cv::Mat dx, dy, magnitude;
+        cv::Mat edgeType, edge;
+        float lowThreshold, highThreshold;
+    };
+
+    static Canny canny(PuRe &pure, const cv::Mat &image, bool blur)
+    {
+        pure.prepareWorkspace(image.size());
+        pure.canny(image, blur, true, 64, 0.7f, 0.4f);
+
+        // copies, as the workspace of pure is reused by the next canny()
+        Canny result;
+        result.dx = pure.dx.clone();
+        result.dy = pure.dy.clone();
+        result.magnitude = pure.magnitude.clone();
+        result.edgeType = pure.edgeType.clone();
+        result.edge = pure.edge.clone();
+        result.lowThreshold = pure.lowThreshold;
+        result.highThreshold = pure.highThreshold;
+        return result;
+    }
+};
+
+/*
+ * The original non maximum suppression of PuRe::canny(): 255 for strong, 128 for weak local maxima along the gradient
+ */
+static cv::Mat referenceNonMaximaSuppression(const cv::Mat &dx, const cv::Mat &dy, const cv::Mat &magnitude, float low_th, float high_th)
+{
+    const float tg22_5 = 0.4142135623730950488016887242097f;
+    const float tg67_5 = 2.4142135623730950488016887242097f;
+    cv::Mat edgeType = cv::Mat::zeros(magnitude.size(), CV_8U);
+    for (int i = 1; i < magnitude.rows - 1; i++)
+    {
+        uchar *_edgeType = edgeType.ptr<uchar>(i);
+
+        const float *p_res = magnitude.ptr<float>(i);
+        const float *p_res_t = magnitude.ptr<float>(i - 1);
+        const float *p_res_b = magnitude.ptr<float>(i + 1);
+
+        const float *p_x = dx.ptr<float>(i);
+        const float *p_y = dy.ptr<float>(i);
+
+        for (int j = 1; j < magnitude.cols - 1; j++)
+        {
+            float m = p_res[j];
+            if (m < low_th)
+                continue;
+
+            float iy = p_y[j];
+            float ix = p_x[j];
+            float y = std::abs((double)iy);
+            float x = std::abs((double)ix);
+
+            uchar val = p_res[j] > high_th ? 255 : 128;
+
+            float tg22_5x = tg22_5 * x;
+            if (y < tg22_5x)
+            {
+                if (m > p_res[j - 1] && m >= p_res[j + 1])
+                    _edgeType[j] = val;
+            }
+            else
+            {
+                float tg67_5x = tg67_5 * x;
+                if (y > tg67_5x)
+                {
+                    if (m > p_res_b[j] && m >= p_res_t[j])
+                        _edgeType[j] = val;
+                }
+                else
+                {
+                    if ((iy <= 0) == (ix <= 0))
+                    {
+                        if (m > p_res_t[j - 1] && m >= p_res_b[j + 1])
+                            _edgeType[j] = val;
+                    }
+                    else
+                    {
+                        if (m > p_res_b[j - 1] && m >= p_res_t[j + 1])
+                            _edgeType[j] = val;
+                    }
+                }
+            }
+        }
+    }
+    return edgeType;
+}
+
+/*
+ * The original breadth-first hysteresis of PuRe::canny(): all edges that are connected to a strong one
+ */
+static cv::Mat referenceHysteresis(const cv::Mat &edgeType)
+{
+    int pic_x = edgeType.cols;
+    int pic_y = edgeType.rows;
+    int area = pic_x * pic_y;
+    int lines_idx = 0;
+    int idx = 0;
+
+    cv::Mat edge = cv::Mat::zeros(edgeType.size(), CV_8U);
+    std::vector<int> lines;
+    for (int i = 1; i < pic_y - 1; i++)
+    {
+        for (int j = 1; j < pic_x - 1; j++)
+        {
+
+            if (edgeType.data[idx + j] != 255 || edge.data[idx + j] != 0)
+                continue;
+
+            edge.data[idx + j] = 255;
+            lines_idx = 1;
+            lines.clear();
+            lines.push_back(idx + j);
+            int akt_idx = 0;
+
+            while (akt_idx < lines_idx)
+            {
+                int akt_pos = lines[akt_idx];
+                akt_idx++;
+
+                if (akt_pos - pic_x - 1 < 0 || akt_pos + pic_x + 1 >= area)
+                    continue;
+
+                for (int k1 = -1; k1 < 2; k1++)
+                    for (int k2 = -1; k2 < 2; k2++)
+                    {
+                        if (edge.data[(akt_pos + (k1 * pic_x)) + k2] != 0 || edgeType.data[(akt_pos + (k1 * pic_x)) + k2] == 0)
+                            continue;
+                        edge.data[(akt_pos + (k1 * pic_x)) + k2] = 255;
+                        lines.push_back((akt_pos + (k1 * pic_x)) + k2);
+                        lines_idx++;
+                    }
+            }
+        }
+        idx += pic_x;
+    }
+    return edge;
+}
+
+/*
+ * A synthetic eye crop with a clipped eyelid and glint, which are 255 without any noise, and a flat patch without gradients.
+ * Their borders are axis-aligned steps, so neighbouring pixels often have exactly the same magnitude.
+ */
+static cv::Mat renderEyeCrop(const cv::Size &size, unsigned int seed)
+{
+    // crops below the renderer's minimum size are cut from a larger one
+    cv::Mat rendered = renderSyntheticEyeCrop(size, seed);
+    cv::Mat crop = rendered(cv::Rect(0, 0, size.width, size.height)).clone();
+
+    cv::rectangle(crop, cv::Rect(0, 0, size.width, size.height / 5), cv::Scalar(255), cv::FILLED);
+    cv::rectangle(crop, cv::Rect(size.width / 2 + size.width / 16, size.height / 3, 3 + size.width / 16, 3 + size.height / 16), cv::Scalar(255), cv::FILLED);
+    cv::rectangle(crop, cv::Rect(0, size.height / 2, size.width / 4, size.height / 2), cv::Scalar(90), cv::FILLED);
+    return crop;
+}
+
+static std::string describe(const cv::Size &size, PuRe::GradientMode mode, bool blur)
+{
+    return std::to_string(size.width) + "x" + std::to_string(size.height) +
+           (mode == PuRe::FAST_GRADIENT ? " fast gradient" : " reference gradient") + (blur ? " blurred" : "");
+}
+
+static void expectReferenceEdges(const cv::Mat &image)
+{
+    for (PuRe::GradientMode mode : {PuRe::REFERENCE_GRADIENT, PuRe::FAST_GRADIENT})
+    {
+        for (bool blur : {true, false})
+        {
+            SCOPED_TRACE(describe(image.size(), mode, blur));
+
+            PuRe pure;
+            pure.setGradientMode(mode);
+            PuReCannyTest::Canny canny = PuReCannyTest::canny(pure, image, blur);
+
+            cv::Mat edgeType = referenceNonMaximaSuppression(canny.dx, canny.dy, canny.magnitude, canny.lowThreshold, canny.highThreshold);
+            cv::Mat edge = referenceHysteresis(edgeType);
+            EXPECT_EQ(cv::countNonZero(canny.edgeType != edgeType), 0) << "pixels with a different edge type";
+            EXPECT_EQ(cv::countNonZero(canny.edge != edge), 0) << "pixels with a different edge";
+        }
+    }
+}
+
+// widths around the multiples of 16, the non maximum suppression skips the first and the last column
+static const std::vector<cv::Size> sizes = {
+    {3, 3}, {17, 13}, {18, 13}, {19, 14}, {33, 25}, {34, 25}, {47, 35}, {64, 48}, {101, 75}, {160, 120}, {161, 121}, {322, 241}};
+
+TEST_F(PuReCannyTest, EyeCropsMatchReference)
+{
+    for (size_t i = 0; i < sizes.size(); i++)
+        expectReferenceEdges(renderEyeCrop(sizes[i], static_cast<unsigned int>(i + 1)));
+}
+
+TEST_F(PuReCannyTest, NoiseMatchesReference)
+{
+    cv::RNG rng(42);
+    for (const cv::Size &size : sizes)
+    {
+        cv::Mat noise(size, CV_8U);
+        rng.fill(noise, cv::RNG::UNIFORM, 0, 256);
+        expectReferenceEdges(noise);
+    }
+}
+
+TEST_F(PuReCannyTest, FlatImagesHaveNoEdges)
+{
+    for (uchar value : {0, 255})
+    {
+        for (const cv::Size &size : sizes)
+        {
+            cv::Mat flat(size, CV_8U, cv::Scalar(value));
+            expectReferenceEdges(flat);
+
+            PuRe pure;
+            EXPECT_EQ(cv::countNonZero(canny(pure, flat, true).edge), 0) << size.width << "x" << size.height;
+        }
+    }
+}
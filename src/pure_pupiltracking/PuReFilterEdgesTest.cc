@@ -0,0 +1,311 @@
+/*
+ * Checks that PuRe::filterEdges() removes and adds exactly the edge pixels of the original implementation.
+ *
+ * The bitmap based filterEdges() is compared with the original one, which visits every pixel and compares it with its
+ * neighbours one after another. The inputs are edge maps of canny() on rendered eye crops, which are in testdata/,
+ * and random maps of several densities, which exercise combinations of neighbours that canny() rarely produces.
+ *
+ * The edge maps in testdata/ are binary PGM files (0 or 255) of PuRe's reference edge detection (5x5 Gaussian with
+ * sigma 1.5, 7x7 Sobel, histogram thresholds, non maximum suppression and hysteresis) on synthetic eye crops.
+ */
+
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "PuRe.h"
+#include "mediapipe/framework/port/opencv_highgui_inc.h"
+#include "mediapipe/framework/port/opencv_imgproc_inc.h"
+
+class PuReFilterEdgesTest : public ::testing::Test
+{
+public:
+    static void filterEdges(PuRe &pure, cv::Mat &edges) { pure.filterEdges(edges); }
+};
+
+/*
+ * The original filterEdges(), which compares every pixel with its neighbours one after another
+ */
+static void filterEdgesReference(cv::Mat &edges)
+{
+    int start_x = 5;
+    int start_y = 5;
+    int end_x = edges.cols - 5;
+    int end_y = edges.rows - 5;
+
+    for (int j = start_y; j < end_y; j++)
+        for (int i = start_x; i < end_x; i++)
+        {
+            uchar box[9];
+
+            box[4] = (uchar)edges.data[(edges.cols * (j)) + (i)];
+
+            if (box[4])
+            {
+                box[1] = (uchar)edges.data[(edges.cols * (j - 1)) + (i)];
+                box[3] = (uchar)edges.data[(edges.cols * (j)) + (i - 1)];
+                box[5] = (uchar)edges.data[(edges.cols * (j)) + (i + 1)];
+                box[7] = (uchar)edges.data[(edges.cols * (j + 1)) + (i)];
+
+                if ((box[5] && box[7]))
+                    edges.data[(edges.cols * (j)) + (i)] = 0;
+                if ((box[5] && box[1]))
+                    edges.data[(edges.cols * (j)) + (i)] = 0;
+                if ((box[3] && box[7]))
+                    edges.data[(edges.cols * (j)) + (i)] = 0;
+                if ((box[3] && box[1]))
+                    edges.data[(edges.cols * (j)) + (i)] = 0;
+            }
+        }
+
+    //too many neigbours
+    for (int j = start_y; j < end_y; j++)
+        for (int i = start_x; i < end_x; i++)
+        {
+            uchar neig = 0;
+
+            for (int k1 = -1; k1 < 2; k1++)
+                for (int k2 = -1; k2 < 2; k2++)
+                {
+
+                    if (edges.data[(edges.cols * (j + k1)) + (i + k2)] > 0)
+                        neig++;
+                }
+
+            if (neig > 3)
+                edges.data[(edges.cols * (j)) + (i)] = 0;
+        }
+
+    for (int j = start_y; j < end_y; j++)
+        for (int i = start_x; i < end_x; i++)
+        {
+            uchar box[17];
+
+            box[4] = (uchar)edges.data[(edges.cols * (j)) + (i)];
+
+            if (box[4])
+            {
+                box[0] = (uchar)edges.data[(edges.cols * (j - 1)) + (i - 1)];
+                box[1] = (uchar)edges.data[(edges.cols * (j - 1)) + (i)];
+                box[2] = (uchar)edges.data[(edges.cols * (j - 1)) + (i + 1)];
+
+                box[3] = (uchar)edges.data[(edges.cols * (j)) + (i - 1)];
+                box[5] = (uchar)edges.data[(edges.cols * (j)) + (i + 1)];
+
+                box[6] = (uchar)edges.data[(edges.cols * (j + 1)) + (i - 1)];
+                box[7] = (uchar)edges.data[(edges.cols * (j + 1)) + (i)];
+                box[8] = (uchar)edges.data[(edges.cols * (j + 1)) + (i + 1)];
+
+                //external
+                box[9] = (uchar)edges.data[(edges.cols * (j)) + (i + 2)];
+                box[10] = (uchar)edges.data[(edges.cols * (j + 2)) + (i)];
+
+                box[11] = (uchar)edges.data[(edges.cols * (j)) + (i + 3)];
+                box[12] = (uchar)edges.data[(edges.cols * (j - 1)) + (i + 2)];
+                box[13] = (uchar)edges.data[(edges.cols * (j + 1)) + (i + 2)];
+
+                box[14] = (uchar)edges.data[(edges.cols * (j + 3)) + (i)];
+                box[15] = (uchar)edges.data[(edges.cols * (j + 2)) + (i - 1)];
+                box[16] = (uchar)edges.data[(edges.cols * (j + 2)) + (i + 1)];
+
+                if ((box[10] && !box[7]) && (box[8] || box[6]))
+                {
+                    edges.data[(edges.cols * (j + 1)) + (i - 1)] = 0;
+                    edges.data[(edges.cols * (j + 1)) + (i + 1)] = 0;
+                    edges.data[(edges.cols * (j + 1)) + (i)] = 255;
+                }
+
+                if ((box[14] && !box[7] && !box[10]) && ((box[8] || box[6]) && (box[16] || box[15])))
+                {
+                    edges.data[(edges.cols * (j + 1)) + (i + 1)] = 0;
+                    edges.data[(edges.cols * (j + 1)) + (i - 1)] = 0;
+                    edges.data[(edges.cols * (j + 2)) + (i + 1)] = 0;
+                    edges.data[(edges.cols * (j + 2)) + (i - 1)] = 0;
+                    edges.data[(edges.cols * (j + 1)) + (i)] = 255;
+                    edges.data[(edges.cols * (j + 2)) + (i)] = 255;
+                }
+
+                if ((box[9] && !box[5]) && (box[8] || box[2]))
+                {
+                    edges.data[(edges.cols * (j + 1)) + (i + 1)] = 0;
+                    edges.data[(edges.cols * (j - 1)) + (i + 1)] = 0;
+                    edges.data[(edges.cols * (j)) + (i + 1)] = 255;
+                }
+
+                if ((box[11] && !box[5] && !box[9]) && ((box[8] || box[2]) && (box[13] || box[12])))
+                {
+                    edges.data[(edges.cols * (j + 1)) + (i + 1)] = 0;
+                    edges.data[(edges.cols * (j - 1)) + (i + 1)] = 0;
+                    edges.data[(edges.cols * (j + 1)) + (i + 2)] = 0;
+                    edges.data[(edges.cols * (j - 1)) + (i + 2)] = 0;
+                    edges.data[(edges.cols * (j)) + (i + 1)] = 255;
+                    edges.data[(edges.cols * (j)) + (i + 2)] = 255;
+                }
+            }
+        }
+
+    for (int j = start_y; j < end_y; j++)
+        for (int i = start_x; i < end_x; i++)
+        {
+
+            uchar box[33];
+
+            box[4] = (uchar)edges.data[(edges.cols * (j)) + (i)];
+
+            if (box[4])
+            {
+                box[0] = (uchar)edges.data[(edges.cols * (j - 1)) + (i - 1)];
+                box[1] = (uchar)edges.data[(edges.cols * (j - 1)) + (i)];
+                box[2] = (uchar)edges.data[(edges.cols * (j - 1)) + (i + 1)];
+
+                box[3] = (uchar)edges.data[(edges.cols * (j)) + (i - 1)];
+                box[5] = (uchar)edges.data[(edges.cols * (j)) + (i + 1)];
+
+                box[6] = (uchar)edges.data[(edges.cols * (j + 1)) + (i - 1)];
+                box[7] = (uchar)edges.data[(edges.cols * (j + 1)) + (i)];
+                box[8] = (uchar)edges.data[(edges.cols * (j + 1)) + (i + 1)];
+
+                box[9] = (uchar)edges.data[(edges.cols * (j - 1)) + (i + 2)];
+                box[10] = (uchar)edges.data[(edges.cols * (j - 1)) + (i - 2)];
+                box[11] = (uchar)edges.data[(edges.cols * (j + 1)) + (i + 2)];
+                box[12] = (uchar)edges.data[(edges.cols * (j + 1)) + (i - 2)];
+
+                box[13] = (uchar)edges.data[(edges.cols * (j - 2)) + (i - 1)];
+                box[14] = (uchar)edges.data[(edges.cols * (j - 2)) + (i + 1)];
+                box[15] = (uchar)edges.data[(edges.cols * (j + 2)) + (i - 1)];
+                box[16] = (uchar)edges.data[(edges.cols * (j + 2)) + (i + 1)];
+
+                box[17] = (uchar)edges.data[(edges.cols * (j - 3)) + (i - 1)];
+                box[18] = (uchar)edges.data[(edges.cols * (j - 3)) + (i + 1)];
+                box[19] = (uchar)edges.data[(edges.cols * (j + 3)) + (i - 1)];
+                box[20] = (uchar)edges.data[(edges.cols * (j + 3)) + (i + 1)];
+
+                box[21] = (uchar)edges.data[(edges.cols * (j + 1)) + (i + 3)];
+                box[22] = (uchar)edges.data[(edges.cols * (j + 1)) + (i - 3)];
+                box[23] = (uchar)edges.data[(edges.cols * (j - 1)) + (i + 3)];
+                box[24] = (uchar)edges.data[(edges.cols * (j - 1)) + (i - 3)];
+
+                box[25] = (uchar)edges.data[(edges.cols * (j - 2)) + (i - 2)];
+                box[26] = (uchar)edges.data[(edges.cols * (j + 2)) + (i + 2)];
+                box[27] = (uchar)edges.data[(edges.cols * (j - 2)) + (i + 2)];
+                box[28] = (uchar)edges.data[(edges.cols * (j + 2)) + (i - 2)];
+
+                box[29] = (uchar)edges.data[(edges.cols * (j - 3)) + (i - 3)];
+                box[30] = (uchar)edges.data[(edges.cols * (j + 3)) + (i + 3)];
+                box[31] = (uchar)edges.data[(edges.cols * (j - 3)) + (i + 3)];
+                box[32] = (uchar)edges.data[(edges.cols * (j + 3)) + (i - 3)];
+
+                if (box[7] && box[2] && box[9])
+                    edges.data[(edges.cols * (j)) + (i)] = 0;
+                if (box[7] && box[0] && box[10])
+                    edges.data[(edges.cols * (j)) + (i)] = 0;
+                if (box[1] && box[8] && box[11])
+                    edges.data[(edges.cols * (j)) + (i)] = 0;
+                if (box[1] && box[6] && box[12])
+                    edges.data[(edges.cols * (j)) + (i)] = 0;
+
+                if (box[0] && box[13] && box[17] && box[8] && box[11] && box[21])
+                    edges.data[(edges.cols * (j)) + (i)] = 0;
+                if (box[2] && box[14] && box[18] && box[6] && box[12] && box[22])
+                    edges.data[(edges.cols * (j)) + (i)] = 0;
+                if (box[6] && box[15] && box[19] && box[2] && box[9] && box[23])
+                    edges.data[(edges.cols * (j)) + (i)] = 0;
+                if (box[8] && box[16] && box[20] && box[0] && box[10] && box[24])
+                    edges.data[(edges.cols * (j)) + (i)] = 0;
+
+                if (box[0] && box[25] && box[2] && box[27])
+                    edges.data[(edges.cols * (j)) + (i)] = 0;
+                if (box[0] && box[25] && box[6] && box[28])
+                    edges.data[(edges.cols * (j)) + (i)] = 0;
+                if (box[8] && box[26] && box[2] && box[27])
+                    edges.data[(edges.cols * (j)) + (i)] = 0;
+                if (box[8] && box[26] && box[6] && box[28])
+                    edges.data[(edges.cols * (j)) + (i)] = 0;
+
+                uchar box2[18];
+                box2[1] = (uchar)edges.data[(edges.cols * (j)) + (i - 1)];
+
+                box2[2] = (uchar)edges.data[(edges.cols * (j - 1)) + (i - 2)];
+                box2[3] = (uchar)edges.data[(edges.cols * (j - 2)) + (i - 3)];
+
+                box2[4] = (uchar)edges.data[(edges.cols * (j - 1)) + (i + 1)];
+                box2[5] = (uchar)edges.data[(edges.cols * (j - 2)) + (i + 2)];
+
+                box2[6] = (uchar)edges.data[(edges.cols * (j + 1)) + (i - 2)];
+                box2[7] = (uchar)edges.data[(edges.cols * (j + 2)) + (i - 3)];
+
+                box2[8] = (uchar)edges.data[(edges.cols * (j + 1)) + (i + 1)];
+                box2[9] = (uchar)edges.data[(edges.cols * (j + 2)) + (i + 2)];
+
+                box2[10] = (uchar)edges.data[(edges.cols * (j + 1)) + (i)];
+
+                box2[15] = (uchar)edges.data[(edges.cols * (j - 1)) + (i - 1)];
+                box2[16] = (uchar)edges.data[(edges.cols * (j - 2)) + (i - 2)];
+
+                box2[11] = (uchar)edges.data[(edges.cols * (j + 2)) + (i + 1)];
+                box2[12] = (uchar)edges.data[(edges.cols * (j + 3)) + (i + 2)];
+
+                box2[13] = (uchar)edges.data[(edges.cols * (j + 2)) + (i - 1)];
+                box2[14] = (uchar)edges.data[(edges.cols * (j + 3)) + (i - 2)];
+
+                if (box2[1] && box2[2] && box2[3] && box2[4] && box2[5])
+                    edges.data[(edges.cols * (j)) + (i)] = 0;
+                if (box2[1] && box2[6] && box2[7] && box2[8] && box2[9])
+                    edges.data[(edges.cols * (j)) + (i)] = 0;
+                if (box2[10] && box2[11] && box2[12] && box2[4] && box2[5])
+                    edges.data[(edges.cols * (j)) + (i)] = 0;
+                if (box2[10] && box2[13] && box2[14] && box2[15] && box2[16])
+                    edges.data[(edges.cols * (j)) + (i)] = 0;
+            }
+        }
+}
+
+static void expectReferenceFilter(const cv::Mat &edges)
+{
+    cv::Mat expected = edges.clone();
+    filterEdgesReference(expected);
+
+    PuRe pure;
+    cv::Mat filtered = edges.clone();
+    PuReFilterEdgesTest::filterEdges(pure, filtered);
+    EXPECT_EQ(cv::countNonZero(filtered != expected), 0) << "pixels that differ from the original filterEdges";
+
+    // the edges of canny() are a view of its workspace, whose rows need not follow each other in memory
+    cv::Mat padded(edges.rows + 2, edges.cols + 13, CV_8U, cv::Scalar(255));
+    cv::Mat view = padded(cv::Rect(5, 1, edges.cols, edges.rows));
+    edges.copyTo(view);
+    PuReFilterEdgesTest::filterEdges(pure, view);
+    EXPECT_EQ(cv::countNonZero(view != expected), 0) << "pixels of a strided map that differ from the original filterEdges";
+    EXPECT_EQ(cv::countNonZero(padded) - cv::countNonZero(view), static_cast<int>(padded.total() - view.total())) << "filterEdges wrote outside of its map";
+}
+
+TEST_F(PuReFilterEdgesTest, CannyEdgesMatchReference)
+{
+    for (const std::string name : {"eye_97x73_edges.pgm", "eye_160x120_edges.pgm", "eye_321x241_edges.pgm"})
+    {
+        SCOPED_TRACE(name);
+        cv::Mat edges = cv::imread("src/pure_pupiltracking/testdata/" + name, cv::IMREAD_GRAYSCALE);
+        ASSERT_FALSE(edges.empty()) << "could not read " << name;
+        ASSERT_EQ(cv::countNonZero((edges != 0) & (edges != 255)), 0) << "not a binary edge map";
+        expectReferenceFilter(edges);
+    }
+}
+
+TEST_F(PuReFilterEdgesTest, RandomEdgesMatchReference)
+{
+    // sizes below the 11 pixels the filter needs, around the 64 pixels of a bitmap word and some odd ones
+    const std::vector<cv::Size> sizes = {{10, 10}, {11, 11}, {12, 9}, {63, 20}, {64, 21}, {65, 22}, {127, 31}, {129, 33}, {200, 150}};
+    cv::RNG rng(2018);
+    for (const cv::Size &size : sizes)
+    {
+        for (float density : {0.05f, 0.2f, 0.5f, 0.8f})
+        {
+            SCOPED_TRACE(std::to_string(size.width) + "x" + std::to_string(size.height) + " density " + std::to_string(density));
+            cv::Mat random(size, CV_32F);
+            rng.fill(random, cv::RNG::UNIFORM, 0.f, 1.f);
+            cv::Mat edges = random < density; // 255 or 0
+            expectReferenceFilter(edges);
+        }
+    }
+}
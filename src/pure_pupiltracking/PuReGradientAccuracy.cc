@@ -0,0 +1,166 @@
+/*
+ * Accuracy report of PuRe's fast gradient mode.
+ *
+ * Runs the reference and the fast gradient mode of PuRe side by side on every frame of a corpus of eye videos (or images)
+ * and compares the detected pupil diameters and confidences as well as the time each mode took.
+ *
+ * Usage: pure_gradient_accuracy <eye video or image> [<eye video or image> ...]
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "PuRe.h"
+#include "mediapipe/framework/port/opencv_highgui_inc.h"
+#include "mediapipe/framework/port/opencv_imgproc_inc.h"
+#include "mediapipe/framework/port/opencv_video_inc.h"
+
+struct AccuracyStats
+{
+    size_t frames = 0;
+    size_t validReference = 0;
+    size_t validFast = 0;
+    size_t validBoth = 0;
+    std::vector<float> diameterDifferences;         // absolute, in pixels. Only for frames where both modes found a pupil
+    std::vector<float> relativeDiameterDifferences; // relative to the reference diameter
+    double confidenceDifferenceSum = 0;
+    double referenceSeconds = 0;
+    double fastSeconds = 0;
+
+    void add(const AccuracyStats &other)
+    {
+        frames += other.frames;
+        validReference += other.validReference;
+        validFast += other.validFast;
+        validBoth += other.validBoth;
+        diameterDifferences.insert(diameterDifferences.end(), other.diameterDifferences.begin(), other.diameterDifferences.end());
+        relativeDiameterDifferences.insert(relativeDiameterDifferences.end(), other.relativeDiameterDifferences.begin(), other.relativeDiameterDifferences.end());
+        confidenceDifferenceSum += other.confidenceDifferenceSum;
+        referenceSeconds += other.referenceSeconds;
+        fastSeconds += other.fastSeconds;
+    }
+};
+
+static float mean(const std::vector<float> &values)
+{
+    if (values.empty())
+        return 0;
+    double sum = 0;
+    for (float value : values)
+        sum += value;
+    return sum / values.size();
+}
+
+static float percentile(std::vector<float> values, float p)
+{
+    if (values.empty())
+        return 0;
+    size_t index = std::min(values.size() - 1, static_cast<size_t>(p * values.size()));
+    std::nth_element(values.begin(), values.begin() + index, values.end());
+    return values[index];
+}
+
+static void compareFrame(const cv::Mat &frame, PuRe &reference, PuRe &fast, AccuracyStats &stats)
+{
+    cv::Mat gray;
+    if (frame.channels() == 3)
+        cv::cvtColor(frame, gray, cv::COLOR_BGR2GRAY);
+    else
+        gray = frame;
+
+    Pupil referencePupil, fastPupil;
+
+    auto start = std::chrono::steady_clock::now();
+    reference.run(gray, referencePupil);
+    auto middle = std::chrono::steady_clock::now();
+    fast.run(gray, fastPupil);
+    auto end = std::chrono::steady_clock::now();
+
+    stats.referenceSeconds += std::chrono::duration<double>(middle - start).count();
+    stats.fastSeconds += std::chrono::duration<double>(end - middle).count();
+    stats.frames++;
+
+    bool referenceValid = referencePupil.valid();
+    bool fastValid = fastPupil.valid();
+    stats.validReference += referenceValid;
+    stats.validFast += fastValid;
+    if (referenceValid && fastValid)
+    {
+        stats.validBoth++;
+        float difference = std::abs(fastPupil.majorAxis() - referencePupil.majorAxis());
+        stats.diameterDifferences.push_back(difference);
+        if (referencePupil.majorAxis() > 0)
+            stats.relativeDiameterDifferences.push_back(difference / referencePupil.majorAxis());
+        stats.confidenceDifferenceSum += std::abs(fastPupil.confidence - referencePupil.confidence);
+    }
+}
+
+static void printStats(const std::string &label, const AccuracyStats &stats)
+{
+    std::cout << std::fixed << std::setprecision(3)
+              << label << "\n"
+              << "    frames: " << stats.frames
+              << ", pupils found by reference: " << stats.validReference
+              << ", by fast: " << stats.validFast
+              << ", by both: " << stats.validBoth << "\n"
+              << "    diameter difference [px]: mean " << mean(stats.diameterDifferences)
+              << ", median " << percentile(stats.diameterDifferences, 0.5f)
+              << ", 95th percentile " << percentile(stats.diameterDifferences, 0.95f)
+              << ", max " << percentile(stats.diameterDifferences, 1.0f) << "\n"
+              << "    relative diameter difference [%]: mean " << 100 * mean(stats.relativeDiameterDifferences)
+              << ", 95th percentile " << 100 * percentile(stats.relativeDiameterDifferences, 0.95f) << "\n"
+              << "    mean confidence difference: " << (stats.validBoth > 0 ? stats.confidenceDifferenceSum / stats.validBoth : 0) << "\n";
+    if (stats.frames > 0)
+        std::cout << "    time per frame [ms]: reference " << 1000 * stats.referenceSeconds / stats.frames
+                  << ", fast " << 1000 * stats.fastSeconds / stats.frames << "\n";
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        std::cerr << "Usage: " << argv[0] << " <eye video or image> [<eye video or image> ...]\n";
+        return 1;
+    }
+
+    AccuracyStats total;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string path = argv[i];
+        // every input starts without any state of the previous one
+        PuRe reference, fast;
+        fast.setGradientMode(PuRe::FAST_GRADIENT);
+        AccuracyStats stats;
+
+        cv::Mat image = cv::imread(path);
+        if (!image.empty())
+        {
+            compareFrame(image, reference, fast, stats);
+        }
+        else
+        {
+            cv::VideoCapture capture(path);
+            if (!capture.isOpened())
+            {
+                std::cerr << "Could not open " << path << "\n";
+                continue;
+            }
+            cv::Mat frame;
+            while (capture.read(frame))
+                compareFrame(frame, reference, fast, stats);
+        }
+
+        printStats(path, stats);
+        total.add(stats);
+    }
+
+    if (argc > 2)
+        printStats("Total", total);
+
+    return 0;
+}
@@ -138,26 +138,51 @@ void PuReST::getThresholds(const Mat &input, const Mat &histogram, const Pupil &
 #endif
 }
 
-void PuReST::generateCombinations(const std::vector<GreedyCandidate> &seeds, std::vector<GreedyCandidate> &candidates, const int length)
+bool PuReST::evaluateGreedyHull(const std::vector<cv::Point> &hull, const float &localMinPupilDiameterPx, const float &minConfidence, Pupil &greedyPupil)
 {
-	if (length > seeds.size())
-		return;
+	const float minCurvatureRatio = 0.198912f; // (1-cos(22.5))/sin(22.5)
+	if (hull.size() < 5)
+		return false;
+	Pupil p = fitEllipse(hull);
+	if (p.majorAxis() < localMinPupilDiameterPx)
+		return false;
+	float aspectRatio = p.minorAxis() / (float)p.majorAxis();
+	if (aspectRatio < minCurvatureRatio)
+		return false;
+	p.confidence = outlineContrastConfidence(input, p);
+	if (p.confidence > greedyPupil.confidence)
+		greedyPupil = p;
+	return greedyPupil.valid(minConfidence);
+}
 
-	vector<bool> v(seeds.size());
-	fill(v.end() - length, v.end(), true);
-	do
+bool PuReST::searchCombinations(const std::vector<GreedyCandidate> &seeds, const size_t &firstSeed, const std::vector<cv::Point> &hull, const float &maxGap,
+								 const float &localMinPupilDiameterPx, const float &minConfidence, Pupil &greedyPupil)
+{
+	for (size_t i = firstSeed; i < seeds.size(); i++)
 	{
-		vector<Point> points;
-		for (int i = 0; i < seeds.size(); i++)
+		// the hull of a combination is the hull of the previous combination's hull and the new seed's hull
+		vector<Point> combinedHull;
+		if (hull.empty())
 		{
-			if (v[i])
-			{
-				const vector<Point> &hull = seeds[i].hull;
-				points.insert(points.end(), hull.begin(), hull.end());
-			}
+			combinedHull = seeds[i].hull;
+		}
+		else
+		{
+			vector<Point> points = hull;
+			points.insert(points.end(), seeds[i].hull.begin(), seeds[i].hull.end());
+			convexHull(points, combinedHull);
+
+			// adding more seeds can only make the combination larger
+			if (convexHullDiameter(combinedHull) > maxGap)
+				continue;
 		}
-		candidates.emplace_back(GreedyCandidate(points));
-	} while (next_permutation(v.begin(), v.end()));
+
+		if (evaluateGreedyHull(combinedHull, localMinPupilDiameterPx, minConfidence, greedyPupil))
+			return true;
+		if (searchCombinations(seeds, i + 1, combinedHull, maxGap, localMinPupilDiameterPx, minConfidence, greedyPupil))
+			return true;
+	}
+	return false;
 }
 
 bool PuReST::trackOutline(const cv::Mat &outlineTrackerEdges, const Pupil &basePupil, Pupil &pupil, const float &localScalingRatio, const float &minOutlineConfidence)
@@ -255,7 +280,7 @@ bool PuReST::greedySearch(const cv::Mat &greedyDetectorEdges, const Pupil &baseP
 		}
 	}
 
-	removeDuplicates(curves, greedyDetectorEdges.cols);
+	removeDuplicates(curves, greedyDetectorEdges.size());
 
 	vector<GreedyCandidate> candidates;
 	for (int i = 0; i < curves.size(); i++)
@@ -316,29 +341,14 @@ bool PuReST::greedySearch(const cv::Mat &greedyDetectorEdges, const Pupil &baseP
 	//waitKey(0);
 #endif
 
-	vector<GreedyCandidate> combined;
-	for (int length = 1; length <= candidates.size(); length++)
-		generateCombinations(candidates, combined, length);
-	candidates.insert(candidates.end(), make_move_iterator(combined.begin()), make_move_iterator(combined.end()));
-
+	// Depth-first search through the combinations of the seeds, largest seeds first.
+	// Combinations that are already larger than a pupil are not extended any further,
+	// and the search stops at the first pupil that would be accepted anyway
+	const float minGreedyConfidence = 0.66f;
 	Pupil greedyPupil;
-	float minCurvatureRatio = 0.198912f; // (1-cos(22.5))/sin(22.5)
-	for (auto c = candidates.begin(); c != candidates.end(); c++)
-	{
-		if (c->hull.size() < 5)
-			continue;
-		Pupil p = fitEllipse(c->hull);
-		if (p.majorAxis() < localMinPupilDiameterPx)
-			continue;
-		float aspectRatio = p.minorAxis() / (float)p.majorAxis();
-		if (aspectRatio < minCurvatureRatio)
-			continue;
-		p.confidence = outlineContrastConfidence(input, p);
-		if (p.confidence > greedyPupil.confidence)
-			greedyPupil = p;
-	}
+	searchCombinations(candidates, 0, vector<Point>(), 1.25 * basePupil.majorAxis(), localMinPupilDiameterPx, minGreedyConfidence, greedyPupil);
 
-	if (greedyPupil.valid(0.66f))
+	if (greedyPupil.valid(minGreedyConfidence))
 	{
 #ifdef DBG_GREEDY_TRACKER
 		Mat tmp;
@@ -400,11 +410,7 @@ void PuReST::run(const cv::Mat &frame, const cv::Rect &roi, const Pupil &previou
 
 	// Setup for Canny
 	workingSize = {input.cols, input.rows};
-	dx = Mat::zeros(workingSize.height, workingSize.width, CV_32F);
-	dy = Mat::zeros(workingSize.height, workingSize.width, CV_32F);
-	magnitude = Mat::zeros(workingSize.height, workingSize.width, CV_32F);
-	edgeType = Mat::zeros(workingSize.height, workingSize.width, CV_8U);
-	edge = Mat::zeros(workingSize.height, workingSize.width, CV_8U);
+	prepareWorkspace(workingSize);
 
 	// Pupil in our coordinate system
 	Pupil basePupil = previousPupil;
@@ -431,9 +437,17 @@ void PuReST::run(const cv::Mat &frame, const cv::Rect &roi, const Pupil &previou
 	Mat detectedEdges = canny(input, true, true, 64, 0.7f, 0.4f);
 	filterEdges(detectedEdges);
 
-	Mat outlineTrackerEdges = detectedEdges.clone();
-	outlineTrackerEdges.setTo(0, bright);
-	outlineTrackerEdges.setTo(0, 255 - dark);
+	// only keep the edges that are dark and not bright, without touching detectedEdges
+	Mat outlineTrackerEdges = workspace.get(PuReWorkspace::OUTLINE_EDGES, detectedEdges.size(), CV_8U);
+	for (int i = 0; i < detectedEdges.rows; i++)
+	{
+		const uchar *p_edges = detectedEdges.ptr<uchar>(i);
+		const uchar *p_bright = bright.ptr<uchar>(i);
+		const uchar *p_dark = dark.ptr<uchar>(i);
+		uchar *p_out = outlineTrackerEdges.ptr<uchar>(i);
+		for (int j = 0; j < detectedEdges.cols; j++)
+			p_out[j] = (p_bright[j] == 0 && p_dark[j] == 255) ? p_edges[j] : 0;
+	}
 	if (trackOutline(outlineTrackerEdges, basePupil, pupil, localScalingRatio))
 	{
 		pupil.resize(1.0 / localScalingRatio);
@@ -441,8 +455,8 @@ void PuReST::run(const cv::Mat &frame, const cv::Rect &roi, const Pupil &previou
 		return;
 	}
 
-	Mat greedyDetectorEdges = detectedEdges.clone();
-	if (greedySearch(greedyDetectorEdges, basePupil, dark, bright, pupil, localScalingRatio * minPupilDiameterPx))
+	// findContours does not modify its input (OpenCV >= 3.2), so the greedy search can work on detectedEdges directly
+	if (greedySearch(detectedEdges, basePupil, dark, bright, pupil, localScalingRatio * minPupilDiameterPx))
 	{
 		pupil.resize(1.0 / localScalingRatio);
 		pupil.shift(Point2f(trackingRect.tl()));
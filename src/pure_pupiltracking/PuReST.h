@@ -54,18 +54,10 @@ public:
 	GreedyCandidate(const std::vector<cv::Point> &points) : points(points)
 	{
 		cv::convexHull(points, hull);
-		maxGap = 0;
+		maxGap = PupilDetectionMethod::convexHullDiameter(hull);
 		meanPoint = {0, 0};
 		for (auto p1 = hull.begin(); p1 != hull.end(); p1++)
-		{
 			meanPoint += cv::Point2f(*p1);
-			for (auto p2 = p1 + 1; p2 != hull.end(); p2++)
-			{
-				float gap = norm(*p2 - *p1);
-				if (gap > maxGap)
-					maxGap = gap;
-			}
-		}
 		meanPoint.x /= points.size();
 		meanPoint.y /= points.size();
 	}
@@ -87,9 +79,12 @@ public:
 		dilateKernel = cv::getStructuringElement(cv::MORPH_ELLIPSE, {15, 15});
 	}
 	static std::string desc;
+	using PuRe::setGradientMode;
 	void run(const cv::Mat &frame, const cv::Rect &roi, const Pupil &previousPupil, Pupil &pupil, const float &userMinPupilDiameterPx = -1, const float &userMaxPupilDiameterPx = -1);
 
 private:
+	friend class PuReBenchmark; // times the single stages of run(), see PuReBenchmarks.cc
+
 	void calculateHistogram(const cv::Mat &in, cv::Mat &histogram, const int &bins, const cv::Mat &mask = cv::Mat());
 	void getThresholds(const cv::Mat &input, const cv::Mat &histogram, const Pupil &pupil, int &lowTh, int &highTh, cv::Mat &bright, cv::Mat &dark);
 	cv::Mat dilateKernel;
@@ -98,7 +93,9 @@ private:
 
 	bool greedySearch(const cv::Mat &greedyDetectorEdges, const Pupil &basePupil, const cv::Mat &dark, const cv::Mat &bright, Pupil &pupil, const float &localMinPupilDiameterPx);
 	bool trackOutline(const cv::Mat &outlineTrackerEdges, const Pupil &basePupil, Pupil &pupil, const float &localScalingRatio, const float &minOutlineConfidence = 0.65f);
-	void generateCombinations(const std::vector<GreedyCandidate> &seeds, std::vector<GreedyCandidate> &candidates, const int length);
+	bool evaluateGreedyHull(const std::vector<cv::Point> &hull, const float &localMinPupilDiameterPx, const float &minConfidence, Pupil &greedyPupil);
+	bool searchCombinations(const std::vector<GreedyCandidate> &seeds, const size_t &firstSeed, const std::vector<cv::Point> &hull, const float &maxGap,
+							const float &localMinPupilDiameterPx, const float &minConfidence, Pupil &greedyPupil);
 	float confidence(const cv::Mat frame, const Pupil &pupil, const std::vector<cv::Point> points);
 };
 
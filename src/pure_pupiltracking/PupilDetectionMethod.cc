@@ -1,5 +1,9 @@
 #include "PupilDetectionMethod.h"
 
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
 using namespace std;
 using namespace cv;
 
@@ -232,7 +236,7 @@ static void inline sincos(int angle, float &cosval, float &sinval)
     cosval = sinTable[450 - angle];
 }
 
-static inline vector<Point> ellipse2Points(const RotatedRect &ellipse, const int &delta = 1)
+int PupilDetectionMethod::ellipseOutlinePoints(const RotatedRect &ellipse, const int &delta, Point *points)
 {
     int angle = ellipse.angle;
 
@@ -246,175 +250,127 @@ static inline vector<Point> ellipse2Points(const RotatedRect &ellipse, const int
     sincos(angle, alpha, beta);
 
     double x, y;
-    vector<Point> points;
+    int nrOfPoints = 0;
     for (int i = 0; i < 360; i += delta)
     {
         x = 0.5 * ellipse.size.width * sinTable[450 - i];
         y = 0.5 * ellipse.size.height * sinTable[i];
-        points.push_back(
-            Point(roundf(ellipse.center.x + x * alpha - y * beta),
-                  roundf(ellipse.center.y + x * beta + y * alpha)));
+        points[nrOfPoints++] = Point(roundf(ellipse.center.x + x * alpha - y * beta),
+                                     roundf(ellipse.center.y + x * beta + y * alpha));
     }
-    return points;
+    return nrOfPoints;
 }
 
-/* Measures the confidence for a pupil based on the inner-outer contrast
- * from the pupil following PuRe. For details, see
- * Thiago Santini, Wolfgang Fuhl, Enkelejda Kasneci
- * "PuRe: Robust pupil detection for real-time pervasive eye tracking"
- * Under review on Elsevier's Computer Vision and Image Understanding journal.
- * TODO: update when published
- */
-float PupilDetectionMethod::outlineContrastConfidence(const Mat &frame, const Pupil &pupil, const int &bias)
+//#define DBG_OUTLINE_CONTRAST
+float PupilDetectionMethod::outlineContrastRatio(const Mat &frame, const RotatedRect &outline, const int &delta, const int &bias, cv::Mat *debugImage)
 {
-    if (!pupil.hasOutline())
-        return NO_CONFIDENCE;
-
     Rect boundaries = {0, 0, frame.cols, frame.rows};
-    int minorAxis = min<int>(pupil.size.width, pupil.size.height);
-    int delta = 0.15 * minorAxis;
-    cv::Point c = pupil.center;
+    cv::Point c = outline.center;
+    const uchar *data = frame.data;
+    const size_t step = frame.step[0];
 
 #ifdef DBG_OUTLINE_CONTRAST
     cv::Mat tmp;
-    cv::cvtColor(frame, tmp, CV_GRAY2BGR);
-    cv::ellipse(tmp, pupil, cv::Scalar(0, 255, 255));
-    cv::Scalar lineColor;
+    if (!debugImage)
+        debugImage = &tmp;
 #endif
+    if (debugImage)
+    {
+        cv::cvtColor(frame, *debugImage, CV_GRAY2BGR);
+        cv::ellipse(*debugImage, outline, cv::Scalar(0, 255, 255));
+    }
     int evaluated = 0;
     int validCount = 0;
 
-    vector<Point> outlinePoints = ellipse2Points(pupil, 10);
-    for (auto p = outlinePoints.begin(); p != outlinePoints.end(); p++)
+    Point outlinePoints[360 / OUTLINE_CONTRAST_SAMPLING_ANGLE];
+    int nrOfOutlinePoints = ellipseOutlinePoints(outline, OUTLINE_CONTRAST_SAMPLING_ANGLE, outlinePoints);
+    for (int i = 0; i < nrOfOutlinePoints; i++)
     {
-        int dx = p->x - c.x;
-        int dy = p->y - c.y;
+        const Point &p = outlinePoints[i];
+        int dx = p.x - c.x;
+        int dy = p.y - c.y;
 
-        float a = 0;
-        if (dx != 0)
-            a = dy / (float)dx;
-        float b = c.y - a * c.x;
-
-        if (a == 0)
+        // rays along the axes are skipped, as the original implementation did
+        if (dx == 0 || dy == 0)
             continue;
 
-        if (abs(dx) > abs(dy))
+        // Sum up the intensities along the ray through p, before and after p.
+        // The ray is walked along its major direction with an integer DDA, which finds the pixel of each sample without
+        // a division or rounding. The samples are read one by one, as the universal intrinsics of OpenCV 3.2
+        // (Ubuntu 18.04, see the Dockerfile) have no gather
+        bool alongX = abs(dx) > abs(dy);
+        int majorCenter = alongX ? c.x : c.y;
+        int minorCenter = alongX ? c.y : c.x;
+        int major = alongX ? p.x : p.y;
+        int slopeNum = alongX ? dy : dx;
+        int slopeDen = alongX ? dx : dy;
+        if (slopeDen < 0)
         {
-            int sx = p->x - delta;
-            int ex = p->x + delta;
-            int sy = std::roundf(a * sx + b);
-            int ey = std::roundf(a * ex + b);
-            cv::Point start = {sx, sy};
-            cv::Point end = {ex, ey};
-            evaluated++;
-
-            if (!boundaries.contains(start) || !boundaries.contains(end))
-                continue;
-
-            float m1, m2, count;
-
-            m1 = count = 0;
-            for (int x = sx; x < p->x; x++)
-                m1 += frame.ptr<uchar>((int)std::roundf(a * x + b))[x];
-            m1 = std::roundf(m1 / delta);
-
-            m2 = count = 0;
-            for (int x = p->x + 1; x <= ex; x++)
-            {
-                m2 += frame.ptr<uchar>((int)std::roundf(a * x + b))[x];
-            }
-            m2 = std::roundf(m2 / delta);
-
-#ifdef DBG_OUTLINE_CONTRAST
-            lineColor = cv::Scalar(0, 0, 255);
-#endif
-            if (p->x < c.x)
-            { // leftwise point
-                if (m1 > m2 + bias)
-                {
-                    validCount++;
-#ifdef DBG_OUTLINE_CONTRAST
-                    lineColor = cv::Scalar(0, 255, 0);
-#endif
-                }
-            }
-            else
-            { // rightwise point
-                if (m2 > m1 + bias)
-                {
-                    validCount++;
-#ifdef DBG_OUTLINE_CONTRAST
-                    lineColor = cv::Scalar(0, 255, 0);
-#endif
-                }
-            }
-
-#ifdef DBG_OUTLINE_CONTRAST
-            cv::line(tmp, start, end, lineColor);
-#endif
+            slopeNum = -slopeNum;
+            slopeDen = -slopeDen;
         }
-        else
-        {
-            int sy = p->y - delta;
-            int ey = p->y + delta;
-            int sx = std::roundf((sy - b) / a);
-            int ex = std::roundf((ey - b) / a);
-            cv::Point start = {sx, sy};
-            cv::Point end = {ex, ey};
-
-            evaluated++;
-            if (!boundaries.contains(start) || !boundaries.contains(end))
-                continue;
 
-            float m1, m2, count;
+        OutlineRayWalker startWalker(majorCenter, minorCenter, slopeNum, slopeDen, major - delta);
+        OutlineRayWalker endWalker(majorCenter, minorCenter, slopeNum, slopeDen, major + delta);
+        cv::Point start = alongX ? cv::Point(major - delta, startWalker.minor()) : cv::Point(startWalker.minor(), major - delta);
+        cv::Point end = alongX ? cv::Point(major + delta, endWalker.minor()) : cv::Point(endWalker.minor(), major + delta);
 
-            m1 = count = 0;
-            for (int y = sy; y < p->y; y++)
-                m1 += frame.ptr<uchar>(y)[(int)std::roundf((y - b) / a)];
-            m1 = std::roundf(m1 / delta);
+        evaluated++;
+        if (!boundaries.contains(start) || !boundaries.contains(end))
+            continue;
 
-            m2 = count = 0;
-            for (int y = p->y + 1; y <= ey; y++)
-                m2 += frame.ptr<uchar>(y)[(int)std::roundf((y - b) / a)];
-            m2 = std::roundf(m2 / delta);
+        // a pixel step along the major and the minor axis
+        int majorStep = alongX ? 1 : (int)step;
+        int minorStep = alongX ? (int)step : 1;
+
+        int sum1 = 0;
+        int sum2 = 0;
+        OutlineRayWalker walker = startWalker;
+        for (int m = major - delta; m < major; m++, walker.step())
+            sum1 += data[m * majorStep + walker.minor() * minorStep];
+        walker.step(); // p itself is not part of either sum
+        for (int m = major + 1; m <= major + delta; m++, walker.step())
+            sum2 += data[m * majorStep + walker.minor() * minorStep];
+        float m1 = std::roundf((float)sum1 / delta);
+        float m2 = std::roundf((float)sum2 / delta);
+
+        // the part of the ray inside the pupil has to be darker
+        bool valid = (alongX ? p.x < c.x : p.y < c.y) ? m1 > m2 + bias : m2 > m1 + bias;
+        if (valid)
+            validCount++;
+
+        if (debugImage)
+            cv::line(*debugImage, start, end, valid ? cv::Scalar(0, 255, 0) : cv::Scalar(0, 0, 255));
+    }
 
 #ifdef DBG_OUTLINE_CONTRAST
-            lineColor = cv::Scalar(0, 0, 255);
-#endif
-            if (p->y < c.y)
-            { // upperwise point
-                if (m1 > m2 + bias)
-                {
-                    validCount++;
-#ifdef DBG_OUTLINE_CONTRAST
-                    lineColor = cv::Scalar(0, 255, 0);
+    cv::imshow("Outline Contrast Debug", *debugImage);
 #endif
-                }
-            }
-            else
-            { // bottomwise point
-                if (m2 > m1 + bias)
-                {
-                    validCount++;
-#ifdef DBG_OUTLINE_CONTRAST
-                    lineColor = cv::Scalar(0, 255, 0);
-#endif
-                }
-            }
 
-#ifdef DBG_OUTLINE_CONTRAST
-            cv::line(tmp, start, end, lineColor);
-#endif
-        }
-    }
     if (evaluated == 0)
-        return 0;
+        return NO_CONFIDENCE;
+    return validCount / (float)evaluated;
+}
 
-#ifdef DBG_OUTLINE_CONTRAST
-    cv::imshow("Outline Contrast Debug", tmp);
-#endif
+/* Measures the confidence for a pupil based on the inner-outer contrast
+ * from the pupil following PuRe. For details, see
+ * Thiago Santini, Wolfgang Fuhl, Enkelejda Kasneci
+ * "PuRe: Robust pupil detection for real-time pervasive eye tracking"
+ * Under review on Elsevier's Computer Vision and Image Understanding journal.
+ * TODO: update when published
+ */
+float PupilDetectionMethod::outlineContrastConfidence(const Mat &frame, const Pupil &pupil, const int &bias)
+{
+    if (!pupil.hasOutline())
+        return NO_CONFIDENCE;
 
-    return validCount / (float)evaluated;
+    int minorAxis = min<int>(pupil.size.width, pupil.size.height);
+    int delta = 0.15 * minorAxis;
+
+    float ratio = outlineContrastRatio(frame, pupil, delta, bias);
+    if (ratio < 0)
+        return 0;
+    return ratio;
 }
 
 float PupilDetectionMethod::angularSpreadConfidence(const vector<Point> &points, const Point2f &center)
@@ -465,3 +421,55 @@ float PupilDetectionMethod::edgeRatioConfidence(const Mat &edgeImage, const Pupi
     findNonZero(inBandEdges, edgePoints);
     return min<float>(edgePoints.size() / pupil.circumference(), 1.0);
 }
+
+static inline long long crossProduct(const Point &o, const Point &a, const Point &b)
+{
+    return (long long)(a.x - o.x) * (b.y - o.y) - (long long)(a.y - o.y) * (b.x - o.x);
+}
+
+static inline long long squaredDistance(const Point &a, const Point &b)
+{
+    long long dx = a.x - b.x;
+    long long dy = a.y - b.y;
+    return dx * dx + dy * dy;
+}
+
+float PupilDetectionMethod::convexHullDiameter(const vector<Point> &hull)
+{
+    if (hull.empty())
+        return 0;
+
+    // collinear vertices would stall the calipers, so only the corners are kept
+    size_t n = hull.size();
+    vector<Point> corners;
+    corners.reserve(n);
+    for (size_t i = 0; i < n; i++)
+        if (crossProduct(hull[(i + n - 1) % n], hull[i], hull[(i + 1) % n]) != 0)
+            corners.push_back(hull[i]);
+
+    long long maxSquaredDistance = 0;
+    if (corners.size() < 3)
+    {
+        // all points lie on a line, whose ends are its lexicographically smallest and largest points
+        auto extremes = minmax_element(hull.begin(), hull.end(), [](const Point &a, const Point &b) {
+            return a.x < b.x || (a.x == b.x && a.y < b.y);
+        });
+        maxSquaredDistance = squaredDistance(*extremes.first, *extremes.second);
+    }
+    else
+    {
+        // for every edge, advance to the corner farthest from it: the diameter is between one of these antipodal pairs
+        n = corners.size();
+        size_t j = 1;
+        for (size_t i = 0; i < n; i++)
+        {
+            size_t next = (i + 1) % n;
+            while (llabs(crossProduct(corners[i], corners[next], corners[(j + 1) % n])) > llabs(crossProduct(corners[i], corners[next], corners[j])))
+                j = (j + 1) % n;
+            maxSquaredDistance = max(maxSquaredDistance, max(squaredDistance(corners[i], corners[j]), squaredDistance(corners[next], corners[j])));
+        }
+    }
+
+    // the same value cv::norm() yields for the difference of the two points
+    return sqrt((double)maxSquaredDistance);
+}
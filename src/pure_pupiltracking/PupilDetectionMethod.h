@@ -11,6 +11,7 @@
 
 #define NO_CONFIDENCE -1.0
 #define SMALLER_THAN_NO_CONFIDENCE NO_CONFIDENCE - 1.0
+#define OUTLINE_CONTRAST_SAMPLING_ANGLE 10
 
 class Pupil : public cv::RotatedRect
 {
@@ -68,6 +69,56 @@ public:
     }
 };
 
+/*
+ * Walks a ray of outlineContrastRatio() one pixel at a time along its major axis (integer DDA).
+ * The ray passes through (majorCenter, minorCenter) with the slope slopeNum / slopeDen, which needs |slopeNum| <= slopeDen.
+ * minor() is the pixel closest to the ray on the other axis, exact ties are rounded up. It is found without any division
+ * or rounding per step.
+ */
+class OutlineRayWalker
+{
+public:
+    /// @param major - the major coordinate of the first pixel of the walk
+    OutlineRayWalker(int majorCenter, int minorCenter, int slopeNum, int slopeDen, int major)
+        : minorCenter(minorCenter),
+          twiceNum(2 * slopeNum),
+          twiceDen(2 * slopeDen)
+    {
+        // minor offset = floor((2 * slopeNum * (major - majorCenter) + slopeDen) / (2 * slopeDen)), with the remainder kept for the steps
+        int numerator = twiceNum * (major - majorCenter) + slopeDen;
+        quotient = numerator / twiceDen;
+        remainder = numerator - quotient * twiceDen;
+        if (remainder < 0)
+        {
+            remainder += twiceDen;
+            quotient--;
+        }
+    }
+
+    int minor() const { return minorCenter + quotient; }
+
+    /// moves on to the next pixel along the major axis
+    void step()
+    {
+        remainder += twiceNum;
+        if (remainder >= twiceDen)
+        {
+            remainder -= twiceDen;
+            quotient++;
+        }
+        else if (remainder < 0)
+        {
+            remainder += twiceDen;
+            quotient--;
+        }
+    }
+
+private:
+    int minorCenter;
+    int twiceNum, twiceDen;
+    int quotient, remainder; // remainder is always in [0, twiceDen)
+};
+
 class PupilDetectionMethod
 {
 public:
@@ -110,10 +161,19 @@ public:
 
     // Generic confidence metrics
     static float outlineContrastConfidence(const cv::Mat &frame, const Pupil &pupil, const int &bias = 5);
+    // Share of the rays across the outline along which the inside of the ellipse is darker than the outside by more than bias.
+    // The rays are 2 * delta pixels long and placed every OUTLINE_CONTRAST_SAMPLING_ANGLE degrees. Returns NO_CONFIDENCE if no ray could be placed.
+    // If debugImage is given, it is set to the frame in color with the outline and the rays drawn on top (green if valid, red if not)
+    static float outlineContrastRatio(const cv::Mat &frame, const cv::RotatedRect &outline, const int &delta, const int &bias, cv::Mat *debugImage = nullptr);
+    // Writes the points of the outline of an ellipse every delta degrees into points, which must hold 360 / delta points. Returns their number
+    static int ellipseOutlinePoints(const cv::RotatedRect &ellipse, const int &delta, cv::Point *points);
     static float edgeRatioConfidence(const cv::Mat &edgeImage, const Pupil &pupil, std::vector<cv::Point> &edgePoints, const int &band = 5);
     static float angularSpreadConfidence(const std::vector<cv::Point> &points, const cv::Point2f &center);
     static float aspectRatioConfidence(const Pupil &pupil);
 
+    // Largest distance between two points of a convex hull (as returned by cv::convexHull), via rotating calipers in O(n)
+    static float convexHullDiameter(const std::vector<cv::Point> &hull);
+
     //Pupil test(const cv::Mat &frame, const cv::Rect &roi, Pupil pupil) { return pupil; }
 protected:
     std::string mDesc;
@@ -0,0 +1,147 @@
+/*
+ * Checks that the integer DDA of PupilDetectionMethod::outlineContrastRatio() samples the pixels of the original ray walk.
+ *
+ * The original walk computed the pixel of each sample with a float division and roundf(). The DDA finds the same pixel,
+ * except where the ray passes exactly halfway between two pixels: there it always takes the upper one, while roundf()
+ * of the float line could go either way. Those samples may be one pixel apart, all others have to be identical.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "PupilDetectionMethod.h"
+#include "mediapipe/framework/port/opencv_core_inc.h"
+#include "mediapipe/framework/port/opencv_imgproc_inc.h"
+
+/*
+ * The pixels of the original ray walk through p, from p - delta to p + delta along the major axis of the ray
+ */
+static std::vector<cv::Point> referenceRayWalk(const cv::Point &c, const cv::Point &p, int delta)
+{
+    int dx = p.x - c.x;
+    int dy = p.y - c.y;
+    float a = dy / (float)dx;
+    float b = c.y - a * c.x;
+
+    std::vector<cv::Point> pixels;
+    if (std::abs(dx) > std::abs(dy))
+    {
+        for (int x = p.x - delta; x <= p.x + delta; x++)
+            pixels.push_back({x, (int)std::roundf(a * x + b)});
+    }
+    else
+    {
+        for (int y = p.y - delta; y <= p.y + delta; y++)
+            pixels.push_back({(int)std::roundf((y - b) / a), y});
+    }
+    return pixels;
+}
+
+/*
+ * The same ray walked with the OutlineRayWalker, set up the way outlineContrastRatio() does
+ */
+static std::vector<cv::Point> ddaRayWalk(const cv::Point &c, const cv::Point &p, int delta, std::vector<bool> &ties)
+{
+    int dx = p.x - c.x;
+    int dy = p.y - c.y;
+    bool alongX = std::abs(dx) > std::abs(dy);
+    int majorCenter = alongX ? c.x : c.y;
+    int minorCenter = alongX ? c.y : c.x;
+    int major = alongX ? p.x : p.y;
+    int slopeNum = alongX ? dy : dx;
+    int slopeDen = alongX ? dx : dy;
+    if (slopeDen < 0)
+    {
+        slopeNum = -slopeNum;
+        slopeDen = -slopeDen;
+    }
+
+    std::vector<cv::Point> pixels;
+    ties.clear();
+    OutlineRayWalker walker(majorCenter, minorCenter, slopeNum, slopeDen, major - delta);
+    for (int m = major - delta; m <= major + delta; m++, walker.step())
+    {
+        pixels.push_back(alongX ? cv::Point(m, walker.minor()) : cv::Point(walker.minor(), m));
+        // the exact minor offset slopeNum * (m - majorCenter) / slopeDen ends in .5
+        ties.push_back((2 * slopeNum * (m - majorCenter) - slopeDen) % (2 * slopeDen) == 0);
+    }
+    return pixels;
+}
+
+static void expectReferencePixels(const cv::Point &c, const cv::Point &p, int delta)
+{
+    SCOPED_TRACE(::testing::Message() << "center " << c << ", outline point " << p << ", delta " << delta);
+
+    std::vector<bool> ties;
+    std::vector<cv::Point> reference = referenceRayWalk(c, p, delta);
+    std::vector<cv::Point> dda = ddaRayWalk(c, p, delta, ties);
+    ASSERT_EQ(reference.size(), dda.size());
+
+    bool alongX = std::abs(p.x - c.x) > std::abs(p.y - c.y);
+    for (size_t i = 0; i < dda.size(); i++)
+    {
+        int majorDiff = alongX ? dda[i].x - reference[i].x : dda[i].y - reference[i].y;
+        int minorDiff = alongX ? dda[i].y - reference[i].y : dda[i].x - reference[i].x;
+        EXPECT_EQ(majorDiff, 0) << "sample " << i;
+        if (ties[i])
+            EXPECT_LE(std::abs(minorDiff), 1) << "sample " << i << " halfway between two pixels";
+        else
+            EXPECT_EQ(minorDiff, 0) << "sample " << i;
+    }
+}
+
+TEST(OutlineRayWalkerTest, RandomRaysMatchReference)
+{
+    cv::RNG rng(42);
+    for (int i = 0; i < 20000; i++)
+    {
+        cv::Point c(rng.uniform(0, 640), rng.uniform(0, 480));
+        cv::Point p(c.x + rng.uniform(-100, 101), c.y + rng.uniform(-100, 101));
+        if (p.x == c.x || p.y == c.y)
+            continue;
+        expectReferencePixels(c, p, rng.uniform(1, 10));
+        if (HasFailure())
+            return;
+    }
+}
+
+TEST(OutlineRayWalkerTest, EllipseOutlinesMatchReference)
+{
+    cv::RNG rng(7);
+    for (int i = 0; i < 500; i++)
+    {
+        cv::RotatedRect outline({rng.uniform(20.0f, 300.0f), rng.uniform(20.0f, 220.0f)},
+                                {rng.uniform(4.0f, 120.0f), rng.uniform(4.0f, 120.0f)}, rng.uniform(0.0f, 180.0f));
+
+        // the outline points and the delta of outlineContrastConfidence()
+        cv::Point outlinePoints[360 / OUTLINE_CONTRAST_SAMPLING_ANGLE];
+        int nrOfOutlinePoints = PupilDetectionMethod::ellipseOutlinePoints(outline, OUTLINE_CONTRAST_SAMPLING_ANGLE, outlinePoints);
+        int delta = (int)(0.15f * std::min(outline.size.width, outline.size.height));
+        for (int j = 0; j < nrOfOutlinePoints; j++)
+        {
+            cv::Point c = outline.center;
+            const cv::Point &p = outlinePoints[j];
+            if (p.x == c.x || p.y == c.y || delta < 1)
+                continue;
+            expectReferencePixels(c, p, delta);
+        }
+        if (HasFailure())
+            return;
+    }
+}
+
+TEST(OutlineRayWalkerTest, DarkPupilHasFullContrast)
+{
+    cv::Mat frame(240, 320, CV_8U, cv::Scalar(200));
+    cv::RotatedRect outline({160.0f, 120.0f}, {80.0f, 60.0f}, 30.0f);
+    cv::ellipse(frame, outline, cv::Scalar(30), cv::FILLED);
+
+    EXPECT_FLOAT_EQ(PupilDetectionMethod::outlineContrastRatio(frame, outline, 9, 5), 1.0f);
+
+    cv::Mat inverted = 230 - frame;
+    EXPECT_FLOAT_EQ(PupilDetectionMethod::outlineContrastRatio(inverted, outline, 9, 5), 0.0f);
+}
@@ -66,7 +66,8 @@ void PupilTrackingMethod::track(const Timestamp &ts, const cv::Mat &frame, const
 	pupil.clear();
 	predictMaxPupilDiameter();
 
-	if (previousPupil.confidence == NO_CONFIDENCE)
+	usedDetection = previousPupil.confidence == NO_CONFIDENCE;
+	if (usedDetection)
 	{
 		pupil = pupilDetectionMethod.runWithConfidence(frame, roi, -1, -1);
 	}
@@ -49,6 +49,9 @@ public:
 
 	std::string description() { return mDesc; }
 
+	// Whether the last track() had to detect the pupil from scratch instead of tracking the previous one
+	bool lastTrackWasDetection() const { return usedDetection; }
+
 private:
 protected:
 	std::string mDesc;
@@ -61,6 +64,7 @@ protected:
 	Timestamp maxTrackingWithoutDetectionTime = 5000;
 	Timestamp lastDetection;
 	bool parallelDetection = false;
+	bool usedDetection = false;
 	float minDetectionConfidence = 0.7f;
 	float minTrackConfidence = 0.9f;
 
@@ -42,11 +42,24 @@
 #include <sstream>
 #include <fstream>
 #include <chrono>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <functional>
+#include <iomanip>
+#include <map>
 
 #include "util/hcmutils.h"
 #include "util/hcmdatatypes.h"
+#include "util/hcmframereader.h"
+#include "util/hcmframesource.h"
+#include "util/hcmrawframesource.h"
+#include "util/hcmstagetimer.h"
+#include "util/hcmtracerecorder.h"
 #include "hcmlabfullfacepupiltracker.h"
 #include "hcmlabsingleeyepupiltracker.h"
+#include "outputwriters/hcmlabpupildatacsvwriter.h"
+#include "outputwriters/hcmlabpupildatassiwriter.h"
 
 #include "mediapipe/framework/port/commandlineflags.h"
 #include "mediapipe/framework/port/opencv_highgui_inc.h"
@@ -55,7 +68,34 @@
 
 DEFINE_string(input_video_path,
 "",
-"Full path of video to load. Only '.mp4' files are supported at the moment!");
+"Full path of video to load. Only '.mp4' files are supported at the moment! "
+"With 'input_raw_format': '-' for stdin, the path of a named pipe or file, or 'unix:<path>' for a Unix domain socket.");
+
+DEFINE_string(input_raw_format,
+"",
+"If provided, the input consists of uncompressed frames of 'input_width' x 'input_height' pixels instead of a video file: "
+"'bgr24' or 'gray8'.");
+
+DEFINE_int32(input_width, 0, "Width in pixels of the raw input frames.");
+
+DEFINE_int32(input_height, 0, "Height in pixels of the raw input frames.");
+
+DEFINE_double(input_fps, 30, "Frame rate of the raw input frames.");
+
+DEFINE_string(input_list,
+"",
+"Path of a text file listing one video per line. All of them are processed in a single run, which reuses "
+"the trackers (and their face tracking graphs) between videos. Overrides 'input_video_path'.");
+
+DEFINE_string(input_dir,
+"",
+"Directory whose '.mp4' files should all be processed in a single run, reusing the trackers between videos. "
+"Overrides 'input_video_path'.");
+
+DEFINE_int32(batch_workers,
+1,
+"Number of videos from 'input_list' or 'input_dir' that are processed concurrently. "
+"Each worker keeps its own tracker alive between videos.");
 
 DEFINE_bool(input_is_single_eye,
 false,
@@ -88,89 +128,471 @@ DEFINE_string(output_base_name,
 "Base file name of the output files. Will be appended by LEFT_EYE, PUPIL_DATA, etc."
 "If not provided, the name of the input video file is used.");
 
-int main(int argc, char **argv)
+DEFINE_int32(pipeline_depth,
+0,
+"Full face mode only: number of frames that are pushed into the face tracking graph ahead of the pupil detection,"
+"so that face tracking and pupil detection run concurrently. 0 (default) processes one frame at a time.");
+
+DEFINE_bool(parallel_eye_detection,
+false,
+"Full face mode only: whether the pupils of the left and right eye should be detected concurrently on two threads."
+"False by default");
+
+DEFINE_int32(decode_buffer_size,
+8,
+"Number of frames that are decoded ahead of the pupil tracking on a separate thread.");
+
+DEFINE_bool(fast_gradients,
+false,
+"Whether the pupil detection should compute its image gradients with a faster, approximate integer filter "
+"instead of the reference float Sobel filters. False by default");
+
+DEFINE_int32(segments,
+1,
+"Number of time segments a single input video is split into. The segments are tracked concurrently, each by its "
+"own tracker on its own thread, and their results are stitched together. 1 (default) processes the video in one piece.");
+
+DEFINE_int32(segment_overlap,
+30,
+"Number of frames before the start of each segment that are tracked (and discarded) to warm up the tracking state.");
+
+DEFINE_string(stage_timings_path,
+"",
+"If provided, the latency of every stage of the pipeline (decoding, face tracking, eye cropping, pupil detection and "
+"tracking, debug rendering, output writing) is measured and its percentiles are written to this file. "
+"A '.json' file is written as JSON, any other file as CSV.");
+
+DEFINE_string(trace_path,
+"",
+"If provided, a timeline of the pipeline's stages per frame and thread is recorded and written to this file as "
+"Chrome trace JSON, to be opened in chrome://tracing or https://ui.perfetto.dev.");
+
+DEFINE_int32(trace_buffer_size,
+200000,
+"Number of trace events each thread keeps. Once its buffer is full, a thread overwrites its oldest events.");
+
+/// Writes the trace, if one is recorded
+static void stopTracing()
 {
-    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    if (FLAGS_trace_path != "" && hcmtrace::stop(FLAGS_trace_path)) {
+        hcmutils::logInfo("Trace written to " + FLAGS_trace_path);
+    }
+}
 
-    gflags::ParseCommandLineFlags(&argc, &argv, true);
+/// Opens the video file or, with 'input_raw_format', the stream of raw frames at inputPath
+static std::unique_ptr<I_HCMFrameSource> openFrameSource(const std::string &inputPath)
+{
+    if (FLAGS_input_raw_format == "") {
+        return std::make_unique<HCMVideoFileFrameSource>(inputPath);
+    }
 
-    if (FLAGS_input_video_path == "") {
-        hcmutils::logError("Please provide a video to work with via the 'input_video_path' command line argument");
-        hcmutils::logInfo("Exiting");
-        return EXIT_FAILURE;
+    HCMRawPixelFormat format;
+    if (!parseRawPixelFormat(FLAGS_input_raw_format, format)) {
+        hcmutils::logError("Unknown raw input format " + FLAGS_input_raw_format + ", use 'bgr24' or 'gray8'");
+        return nullptr;
+    }
+    return std::make_unique<HCMRawFrameSource>(inputPath, format, FLAGS_input_width, FLAGS_input_height, FLAGS_input_fps);
+}
+
+/// Name of an input to name its outputs after: the file name without '.mp4', or "stdin"
+static std::string inputNameOf(const std::string &inputPath)
+{
+    if (inputPath == "-") {
+        return "stdin";
+    }
+    return hcmutils::extractFileNameFromPath(inputPath, ".mp4");
+}
+
+/// Names the outputs of every input of a batch. Inputs with the same file name (e.g. 'a/p01.mp4' and 'b/p01.mp4')
+/// would overwrite each other's outputs, so their names are prefixed with their parent directory
+/// and, if that is not enough to tell them apart (e.g. a video listed twice), suffixed with a running number.
+static std::vector<std::string> batchOutputNamesOf(const std::vector<std::string> &inputPaths)
+{
+    std::vector<std::string> outputNames;
+    std::map<std::string, size_t> occurrences;
+    for (auto &inputPath : inputPaths) {
+        outputNames.push_back(inputNameOf(inputPath));
+        occurrences[outputNames.back()]++;
+    }
+
+    for (size_t i = 0; i < inputPaths.size(); i++) {
+        if (occurrences[outputNames[i]] < 2) {
+            continue;
+        }
+
+        std::string parentDir = inputPaths[i].substr(0, inputPaths[i].find_last_of('/') + 1);
+        while (!parentDir.empty() && parentDir.back() == '/') {
+            parentDir.pop_back();
+        }
+        parentDir = parentDir.substr(parentDir.find_last_of('/') + 1);
+        if (parentDir != "" && parentDir != "." && parentDir != "..") {
+            outputNames[i] = parentDir + "_" + outputNames[i];
+        }
+    }
+
+    std::map<std::string, size_t> uses;
+    for (auto &outputName : outputNames) {
+        uses[outputName]++;
+    }
+    std::map<std::string, size_t> numbers;
+    for (size_t i = 0; i < outputNames.size(); i++) {
+        if (uses[outputNames[i]] > 1) {
+            size_t number = ++numbers[outputNames[i]];
+            if (number == 1) {
+                hcmutils::logInfo("Several inputs are named " + outputNames[i] + ", their outputs are numbered");
+            }
+            outputNames[i] += "_" + std::to_string(number);
+        }
     }
+    return outputNames;
+}
 
-    // use input file name in case no output file name was provided
-    std::string inputFileName = hcmutils::extractFileNameFromPath(FLAGS_input_video_path, ".mp4");
+/// Creates the tracker matching the command line flags for a video with the given properties
+static std::unique_ptr<I_HCMLabPupilTracker> createPupilTracker(int videoWidth, int videoHeight, double fps,
+                                                                const std::string &outputDirPath, const std::string &outputBaseName)
+{
+    if (FLAGS_input_is_single_eye) {
+        return std::make_unique<HCMLabSingleEyePupilTracker>(videoWidth, videoHeight, fps, true,
+                                    true, FLAGS_render_debug_video, outputDirPath, outputBaseName, FLAGS_fast_gradients);
+    } else {
+        return std::make_unique<HCMLabFullFacePupilTracker>(videoWidth, videoHeight, fps, true,
+                                    true, FLAGS_render_debug_video, outputDirPath, outputBaseName,
+                                    std::max(FLAGS_pipeline_depth, 0), FLAGS_parallel_eye_detection, FLAGS_fast_gradients);
+    }
+}
+
+/// Runs all frames of a video through the pupilTracker.
+/// The tracker is created for the first video and reset for every following one,
+/// so its expensive resources (e.g. the mediapipe graph) are only set up once.
+/// @param outputName - name of the folder inside FLAGS_output_dir the outputs are saved to
+/// @param outputBaseName - base name of the output files, outputName is used if empty
+/// @param processedFrames - output parameter. number of frames of the video that were processed
+static bool processVideo(const std::string &inputVideoPath, const std::string &outputName, std::string outputBaseName,
+                         std::unique_ptr<I_HCMLabPupilTracker> &pupilTracker, bool displayProgress, size_t &processedFrames)
+{
+    std::string inputFileName = inputNameOf(inputVideoPath);
 
-    std::string outputBaseName = FLAGS_output_base_name;
+    // use the output name in case no output file name was provided
     if (outputBaseName == "") {
-        outputBaseName = inputFileName;
+        outputBaseName = outputName;
     }
 
-    std::string outputDirPath = FLAGS_output_dir + inputFileName + "/";
+    std::string outputDirPath = FLAGS_output_dir + outputName + "/";
     hcmutils::createDirectoryIfNecessary(outputDirPath);
 
 
     //load video and run all stuff
-    cv::VideoCapture inputCapture;
-    inputCapture.open(FLAGS_input_video_path);
-    auto videoLength = inputCapture.get(cv::CAP_PROP_FRAME_COUNT);
-    auto videoWidth = inputCapture.get(cv::CAP_PROP_FRAME_WIDTH);
-    auto videoHeight = inputCapture.get(cv::CAP_PROP_FRAME_HEIGHT);
-    auto fps = inputCapture.get(cv::CAP_PROP_FPS);
-
-    if (!inputCapture.isOpened()) {
-        hcmutils::logError("Could not open " + FLAGS_input_video_path);
-        return EXIT_FAILURE;
+    std::unique_ptr<I_HCMFrameSource> frameSource = openFrameSource(inputVideoPath);
+    if (!frameSource || !frameSource->isOpened()) {
+        hcmutils::logError("Could not open " + inputVideoPath);
+        return false;
     }
 
+    auto videoLength = frameSource->frameCount(); // 0 for streams of raw frames
+    auto videoWidth = frameSource->width();
+    auto videoHeight = frameSource->height();
+    auto fps = frameSource->fps();
+
     hcmutils::logInfo("Opened video " + inputFileName);
-    cv::Mat camera_frame_raw;
     size_t ts = 0;
 
-    I_HCMLabPupilTracker *pupilTracker = nullptr;
-
-    if (FLAGS_input_is_single_eye) {
-        pupilTracker = new HCMLabSingleEyePupilTracker(videoWidth, videoHeight, fps, true,
-                                    true, FLAGS_render_debug_video, outputDirPath, outputBaseName);
+    if (pupilTracker) {
+        pupilTracker->reset(videoWidth, videoHeight, fps, outputDirPath, outputBaseName);
     } else {
-        pupilTracker = new HCMLabFullFacePupilTracker(videoWidth, videoHeight, fps, true,
-                                    true, FLAGS_render_debug_video, outputDirPath, outputBaseName);
+        pupilTracker = createPupilTracker(videoWidth, videoHeight, fps, outputDirPath, outputBaseName);
     }
 
     if (!pupilTracker->init()) {
         hcmutils::logError("Could not initialize PupilTracker");
-        delete pupilTracker;
-        return EXIT_FAILURE;
+        pupilTracker.reset();
+        return false;
     }
 
-    while (true) {
-        inputCapture >> camera_frame_raw;
-        if (camera_frame_raw.empty()) {
-            break; // End of video.
-        }
+    HCMFrameReader frameReader(*frameSource, std::max(FLAGS_decode_buffer_size, 1));
+    frameReader.start();
 
-        pupilTracker->process(camera_frame_raw, ts);
+    while (const cv::Mat *camera_frame_raw = frameReader.acquireFrame()) {
+        pupilTracker->process(*camera_frame_raw, ts);
+        frameReader.releaseFrame();
 
-        hcmutils::showProgress("Processing", ts, videoLength);
+        if (displayProgress && videoLength > 0) {
+            hcmutils::showProgress("Processing", ts, videoLength);
+        }
         ts++;
     }
-    hcmutils::endProgressDisplay();
+    frameReader.stop();
+    if (displayProgress) {
+        hcmutils::endProgressDisplay();
+    }
+
+    processedFrames = ts;
 
     if (!pupilTracker->stop()) {
         hcmutils::logError("Error stopping PupilTracker");
-        delete pupilTracker;
+        pupilTracker.reset();
+        return false;
+    }
+
+    hcmutils::logInfo("Finished video " + inputFileName);
+    return true;
+}
+
+/// Splits the video into FLAGS_segments time segments that are tracked concurrently, each by its own tracker.
+/// Every segment (except the first) starts FLAGS_segment_overlap frames early, so that the tracking state is warmed up
+/// when its first own frame is reached. The results of these warm-up frames are discarded before the segments are stitched.
+/// No debug video is rendered in this mode. Fails if any segment but the last one ends early, instead of leaving a gap.
+/// @param processedFrames - output parameter. number of frames of the video that were processed
+static bool processVideoInSegments(const std::string &inputVideoPath, std::string outputBaseName, size_t &processedFrames)
+{
+    std::string inputFileName = inputNameOf(inputVideoPath);
+
+    if (outputBaseName == "") {
+        outputBaseName = inputFileName;
+    }
+
+    std::string outputDirPath = FLAGS_output_dir + inputFileName + "/";
+    hcmutils::createDirectoryIfNecessary(outputDirPath);
+
+    size_t videoLength;
+    int videoWidth, videoHeight;
+    double fps;
+    {
+        HCMVideoFileFrameSource inputVideo(inputVideoPath);
+        if (!inputVideo.isOpened()) {
+            hcmutils::logError("Could not open " + inputVideoPath);
+            return false;
+        }
+
+        videoLength = inputVideo.frameCount();
+        videoWidth = inputVideo.width();
+        videoHeight = inputVideo.height();
+        fps = inputVideo.fps();
+    }
+
+    size_t nrOfSegments = std::min<size_t>(std::max(FLAGS_segments, 1), std::max<size_t>(videoLength, 1));
+    size_t overlap = std::max(FLAGS_segment_overlap, 0);
+
+    if (FLAGS_render_debug_video) {
+        hcmutils::logInfo("No debug video is rendered when the video is split into segments");
+    }
+
+    std::ostringstream segmentStream;
+    segmentStream << "Opened video " << inputFileName << ", tracking it as " << nrOfSegments << " segments";
+    hcmutils::logInfo(segmentStream.str());
+
+    std::vector<std::vector<PupilTrackingDataFrame>> segmentTrackingData(nrOfSegments);
+    std::vector<char> segmentSucceeded(nrOfSegments, false); // not vector<bool>, its elements are written from different threads
+
+    std::vector<std::function<void()>> segmentTasks;
+    for (size_t segment = 0; segment < nrOfSegments; ++segment) {
+        segmentTasks.push_back([&, segment] {
+            size_t segmentStart = videoLength * segment / nrOfSegments;
+            size_t segmentEnd = videoLength * (segment + 1) / nrOfSegments;
+            size_t warmupStart = segmentStart - std::min(overlap, segmentStart);
+            hcmtrace::setThreadName("segment_worker");
+
+            HCMVideoFileFrameSource segmentVideo(inputVideoPath);
+            if (!segmentVideo.isOpened() || !segmentVideo.seek(warmupStart)) {
+                hcmutils::logError("Could not seek to the start of a segment in " + inputVideoPath);
+                return;
+            }
+
+            // the segment trackers do not write any outputs themselves, the stitched data is written out below
+            std::unique_ptr<I_HCMLabPupilTracker> pupilTracker;
+            if (FLAGS_input_is_single_eye) {
+                pupilTracker = std::make_unique<HCMLabSingleEyePupilTracker>(videoWidth, videoHeight, fps, false,
+                                            false, false, outputDirPath, outputBaseName, FLAGS_fast_gradients);
+            } else {
+                pupilTracker = std::make_unique<HCMLabFullFacePupilTracker>(videoWidth, videoHeight, fps, false,
+                                            false, false, outputDirPath, outputBaseName,
+                                            std::max(FLAGS_pipeline_depth, 0), FLAGS_parallel_eye_detection, FLAGS_fast_gradients);
+            }
+
+            if (!pupilTracker->init()) {
+                hcmutils::logError("Could not initialize PupilTracker");
+                return;
+            }
+
+            HCMFrameReader frameReader(segmentVideo, std::max(FLAGS_decode_buffer_size, 1), warmupStart);
+            frameReader.start();
+
+            size_t ts = warmupStart;
+            while (ts < segmentEnd) {
+                const cv::Mat *camera_frame_raw = frameReader.acquireFrame();
+                if (!camera_frame_raw) {
+                    break;
+                }
+                pupilTracker->process(*camera_frame_raw, ts);
+                frameReader.releaseFrame();
+                ts++;
+            }
+            frameReader.stop();
+
+            if (!pupilTracker->stop()) {
+                hcmutils::logError("Error stopping PupilTracker");
+                return;
+            }
+
+            auto &trackingData = pupilTracker->getTrackingData();
+            size_t warmupFrames = std::min(segmentStart - warmupStart, trackingData.size());
+
+            auto &stitchData = segmentTrackingData[segment];
+            stitchData.assign(trackingData.begin() + warmupFrames, trackingData.end());
+
+            // the detectors count their timestamps from the start of the segment
+            for (auto &dataFrame : stitchData) {
+                dataFrame.left.ts += warmupStart;
+                dataFrame.right.ts += warmupStart;
+            }
+
+            if (ts < segmentEnd) {
+                std::ostringstream shortStream;
+                shortStream << "Segment " << segment << " ended after frame " << ts << " instead of " << segmentEnd;
+                if (segment + 1 < nrOfSegments) {
+                    // the next segment starts at segmentEnd, so the stitched data would have a gap
+                    // (e.g. the seek landed short, a frame could not be decoded or the frame count was off)
+                    hcmutils::logError(shortStream.str());
+                    return;
+                }
+                // the frame count of a video is only an estimate, the last segment simply ends with the video
+                hcmutils::logInfo(shortStream.str());
+            }
+            segmentSucceeded[segment] = true;
+        });
+    }
+
+    hcmutils::runMultiThreaded(segmentTasks);
+
+    if (std::find(segmentSucceeded.begin(), segmentSucceeded.end(), false) != segmentSucceeded.end()) {
+        hcmutils::logError("Not all segments of " + inputFileName + " could be tracked");
+        return false;
+    }
+
+    std::vector<PupilTrackingDataFrame> trackingData;
+    trackingData.reserve(videoLength);
+    for (auto &segmentData : segmentTrackingData) {
+        trackingData.insert(trackingData.end(), segmentData.begin(), segmentData.end());
+    }
+
+    {
+        HCMStageTimer timer(HCMStage::OUTPUT_WRITING);
+
+        HCMLabPupilDataCSVWriter csvWriter(outputDirPath, outputBaseName);
+        csvWriter.write(trackingData);
+
+        HCMLabPupilDataSSIWriter ssiWriter(outputDirPath, outputBaseName, fps);
+        ssiWriter.write(trackingData);
+    }
+
+    processedFrames = trackingData.size();
+
+    hcmutils::logInfo("Finished video " + inputFileName);
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+
+    gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+    if (FLAGS_stage_timings_path != "") {
+        hcmstagetimer::enable();
+    }
+
+    if (FLAGS_trace_path != "") {
+        hcmtrace::start(static_cast<size_t>(std::max(FLAGS_trace_buffer_size, 1)));
+        hcmtrace::setThreadName("main");
+    }
+
+    bool isBatch = FLAGS_input_list != "" || FLAGS_input_dir != "";
+
+    std::vector<std::string> inputVideoPaths;
+    if (FLAGS_input_list != "") {
+        inputVideoPaths = hcmutils::readLinesFromFile(FLAGS_input_list);
+    } else if (FLAGS_input_dir != "") {
+        inputVideoPaths = hcmutils::listFilesInDirectory(FLAGS_input_dir, ".mp4");
+    } else if (FLAGS_input_video_path != "") {
+        inputVideoPaths.push_back(FLAGS_input_video_path);
+    }
+
+    if (inputVideoPaths.empty()) {
+        hcmutils::logError("Please provide a video to work with via the 'input_video_path', 'input_list' or 'input_dir' command line arguments");
+        hcmutils::logInfo("Exiting");
         return EXIT_FAILURE;
     }
 
-    delete pupilTracker;
+    size_t ts = 0;
+
+    if (FLAGS_segments > 1 && FLAGS_input_raw_format != "") {
+        hcmutils::logInfo("Ignoring 'segments' for raw input frames, a stream can't be split into segments");
+    }
+
+    if (!isBatch && FLAGS_segments > 1 && FLAGS_input_raw_format == "") {
+        if (!processVideoInSegments(inputVideoPaths.front(), FLAGS_output_base_name, ts)) {
+            stopTracing();
+            return EXIT_FAILURE;
+        }
+    } else if (!isBatch) {
+        std::unique_ptr<I_HCMLabPupilTracker> pupilTracker;
+        if (!processVideo(inputVideoPaths.front(), inputNameOf(inputVideoPaths.front()), FLAGS_output_base_name, pupilTracker, true, ts)) {
+            stopTracing();
+            return EXIT_FAILURE;
+        }
+    } else {
+        if (FLAGS_output_base_name != "") {
+            hcmutils::logInfo("Ignoring 'output_base_name' in batch mode, the outputs are named after their input videos");
+        }
+        if (FLAGS_segments > 1) {
+            hcmutils::logInfo("Ignoring 'segments' in batch mode, the videos are already processed in parallel");
+        }
+
+        std::vector<std::string> outputNames = batchOutputNamesOf(inputVideoPaths);
+
+        std::atomic<size_t> nextVideoIndex(0);
+        std::atomic<size_t> processedFrames(0);
+        std::atomic<size_t> failedVideos(0);
+
+        // every worker keeps its tracker warm and pulls the next unprocessed video until none are left
+        auto worker = [&] {
+            hcmtrace::setThreadName("batch_worker");
+            std::unique_ptr<I_HCMLabPupilTracker> pupilTracker;
+            for (size_t i = nextVideoIndex++; i < inputVideoPaths.size(); i = nextVideoIndex++) {
+                size_t framesOfVideo = 0;
+                if (processVideo(inputVideoPaths[i], outputNames[i], "", pupilTracker, false, framesOfVideo)) {
+                    processedFrames += framesOfVideo;
+                } else {
+                    failedVideos++;
+                }
+            }
+        };
+
+        size_t nrOfWorkers = std::min<size_t>(std::max(FLAGS_batch_workers, 1), inputVideoPaths.size());
+        hcmutils::runMultiThreaded(std::vector<std::function<void()>>(nrOfWorkers, worker));
+
+        ts = processedFrames;
+
+        std::ostringstream batchStream;
+        batchStream << inputVideoPaths.size() - failedVideos << " of " << inputVideoPaths.size() << " videos processed successfully.";
+        hcmutils::logInfo(batchStream.str());
+        if (failedVideos > 0) {
+            hcmutils::logError("Some videos could not be processed, see the log above");
+        }
+    }
 
     std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
-    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - begin).count() / 1000;
+    double seconds = std::chrono::duration<double>(end - begin).count();
     std::ostringstream tsStream;
-    tsStream << ts << " frames processed in " << duration << " seconds " << " => Speed: " << ts / duration << " fps.";
+    tsStream << ts << " frames processed in " << std::fixed << std::setprecision(2) << seconds << " seconds";
+    if (seconds > 0) {
+        tsStream << " => Speed: " << ts / seconds << " fps.";
+    }
     hcmutils::logInfo(tsStream.str());
+
+    if (FLAGS_stage_timings_path != "" && hcmstagetimer::writeSummary(FLAGS_stage_timings_path)) {
+        hcmutils::logInfo("Stage timings written to " + FLAGS_stage_timings_path);
+    }
+    stopTracing();
     hcmutils::logProgramEnd();
     return EXIT_SUCCESS;
-}
\ No newline at end of file
+}
@@ -0,0 +1,129 @@
+#include "hcmframereader.h"
+
+#include <algorithm>
+
+#include "hcmstagetimer.h"
+#include "hcmtracerecorder.h"
+
+HCMFrameReader::HCMFrameReader(I_HCMFrameSource &frameSource, size_t ringSize, size_t firstFrameNr) :
+    m_frameSource(frameSource),
+    m_ring(std::max<size_t>(ringSize, 1)),
+    m_firstFrameNr(firstFrameNr),
+    m_readIndex(0),
+    m_filledSlots(0),
+    m_endOfVideo(false),
+    m_stopRequested(false)
+{
+    // preallocate the slots so the decoder can write into existing buffers right away
+    int width = m_frameSource.width();
+    int height = m_frameSource.height();
+    if (width > 0 && height > 0)
+    {
+        for (auto &slot : m_ring)
+        {
+            slot.create(height, width, CV_8UC3);
+        }
+    }
+}
+
+HCMFrameReader::~HCMFrameReader()
+{
+    stop();
+}
+
+void HCMFrameReader::start()
+{
+    m_decoderThread = std::thread([this] {
+        decodeFrames();
+    });
+}
+
+const cv::Mat *HCMFrameReader::acquireFrame()
+{
+    std::unique_lock<std::mutex> lock(m_ringMutex);
+    m_frameDecoded.wait(lock, [this] {
+        return m_filledSlots > 0 || m_endOfVideo;
+    });
+
+    if (m_filledSlots == 0)
+    {
+        return nullptr;
+    }
+
+    return &m_ring[m_readIndex];
+}
+
+void HCMFrameReader::releaseFrame()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_ringMutex);
+        m_readIndex = (m_readIndex + 1) % m_ring.size();
+        m_filledSlots--;
+    }
+    m_frameReleased.notify_one();
+}
+
+void HCMFrameReader::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_ringMutex);
+        m_stopRequested = true;
+    }
+    m_frameReleased.notify_one();
+
+    if (m_decoderThread.joinable())
+    {
+        m_decoderThread.join();
+    }
+}
+
+void HCMFrameReader::decodeFrames()
+{
+    size_t writeIndex = 0;
+    size_t frameNr = m_firstFrameNr;
+    hcmtrace::setThreadName("frame_reader");
+
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(m_ringMutex);
+            m_frameReleased.wait(lock, [this] {
+                return m_filledSlots < m_ring.size() || m_stopRequested;
+            });
+
+            if (m_stopRequested)
+            {
+                break;
+            }
+        }
+
+        // the slot at writeIndex is not visible to the consumer, so it can be decoded into without holding the lock.
+        // read() reuses the slot's buffer as long as the frame size does not change
+        bool decoded;
+        {
+            hcmtrace::setCurrentFrame(static_cast<int64_t>(frameNr));
+            HCMStageTimer timer(HCMStage::DECODE);
+            decoded = m_frameSource.read(m_ring[writeIndex]);
+        }
+        if (!decoded || m_ring[writeIndex].empty())
+        {
+            break; // End of video.
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_ringMutex);
+            m_filledSlots++;
+        }
+        m_frameDecoded.notify_one();
+
+        writeIndex = (writeIndex + 1) % m_ring.size();
+        frameNr++;
+    }
+    hcmtrace::setCurrentFrame(hcmtrace::NO_FRAME);
+
+    {
+        std::lock_guard<std::mutex> lock(m_ringMutex);
+        m_endOfVideo = true;
+    }
+    m_frameDecoded.notify_all();
+}
@@ -0,0 +1,68 @@
+#ifndef HCMLAB_FRAMEREADER_H
+#define HCMLAB_FRAMEREADER_H
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "mediapipe/framework/port/opencv_core_inc.h"
+
+#include "hcmframesource.h"
+
+/**
+ * Decodes the frames of an opened frame source (e.g. a video file) on a dedicated thread into a fixed-size ring of preallocated frames.
+ * This way decoding the next frames overlaps with processing the current one.
+ *
+ * Follows the paradigm of calling:
+ * HCMFrameReader reader(frameSource, 8);
+ * reader.start();
+ *
+ * while (const cv::Mat *frame = reader.acquireFrame()) {
+ *      ...use *frame...
+ *      reader.releaseFrame();
+ * }
+ *
+ * reader.stop();
+ *
+ * The decoder blocks as soon as all slots of the ring are filled and waits for the consumer to release one (backpressure).
+ */
+class HCMFrameReader
+{
+public:
+    /// @param firstFrameNr - number of the source's first frame, only used to attribute the decoding to frames in a trace
+    HCMFrameReader(I_HCMFrameSource &frameSource, size_t ringSize, size_t firstFrameNr = 0);
+    ~HCMFrameReader();
+
+    void start();
+
+    /// Blocks until the next frame is decoded.
+    /// @returns the next frame, which stays valid until releaseFrame() is called, or nullptr once the video has ended
+    const cv::Mat *acquireFrame();
+
+    /// Hands the frame returned by the last acquireFrame() call back to the decoder thread
+    void releaseFrame();
+
+    /// Stops decoding, even if the video has not ended yet
+    void stop();
+
+private:
+    void decodeFrames();
+
+    I_HCMFrameSource &m_frameSource;
+    std::vector<cv::Mat> m_ring;
+    size_t m_firstFrameNr;
+
+    size_t m_readIndex;   // slot of the oldest decoded frame
+    size_t m_filledSlots; // number of decoded frames that were not released yet
+    bool m_endOfVideo;
+    bool m_stopRequested;
+
+    std::mutex m_ringMutex;
+    std::condition_variable m_frameDecoded;
+    std::condition_variable m_frameReleased;
+
+    std::thread m_decoderThread;
+};
+
+#endif // HCMLAB_FRAMEREADER_H
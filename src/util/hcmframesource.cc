@@ -0,0 +1,42 @@
+#include "hcmframesource.h"
+
+HCMVideoFileFrameSource::HCMVideoFileFrameSource(const std::string &path)
+{
+    m_capture.open(path);
+}
+
+bool HCMVideoFileFrameSource::isOpened() const
+{
+    return m_capture.isOpened();
+}
+
+bool HCMVideoFileFrameSource::read(cv::Mat &frame)
+{
+    return m_capture.read(frame) && !frame.empty();
+}
+
+int HCMVideoFileFrameSource::width() const
+{
+    return static_cast<int>(m_capture.get(cv::CAP_PROP_FRAME_WIDTH));
+}
+
+int HCMVideoFileFrameSource::height() const
+{
+    return static_cast<int>(m_capture.get(cv::CAP_PROP_FRAME_HEIGHT));
+}
+
+double HCMVideoFileFrameSource::fps() const
+{
+    return m_capture.get(cv::CAP_PROP_FPS);
+}
+
+size_t HCMVideoFileFrameSource::frameCount() const
+{
+    double frameCount = m_capture.get(cv::CAP_PROP_FRAME_COUNT);
+    return frameCount > 0 ? static_cast<size_t>(frameCount) : 0;
+}
+
+bool HCMVideoFileFrameSource::seek(size_t frameNr)
+{
+    return m_capture.set(cv::CAP_PROP_POS_FRAMES, static_cast<double>(frameNr));
+}
@@ -0,0 +1,53 @@
+#ifndef HCMLAB_FRAMESOURCE_H
+#define HCMLAB_FRAMESOURCE_H
+
+#include <cstddef>
+#include <string>
+
+#include "mediapipe/framework/port/opencv_core_inc.h"
+#include "mediapipe/framework/port/opencv_video_inc.h"
+
+/**
+ * Interface for the inputs the pipeline reads its frames from, e.g. a video file or a stream of raw frames.
+ * All sources deliver 8 bit BGR frames.
+ */
+class I_HCMFrameSource
+{
+public:
+    virtual ~I_HCMFrameSource() {}
+
+    virtual bool isOpened() const = 0;
+
+    /// Reads the next frame into the buffer of frame. Only allocates if frame does not have the source's size or is not CV_8UC3
+    /// @returns false once the input has ended
+    virtual bool read(cv::Mat &frame) = 0;
+
+    virtual int width() const = 0;
+    virtual int height() const = 0;
+    virtual double fps() const = 0;
+
+    /// @returns the number of frames of the input, or 0 if it is not known in advance (e.g. for a stream)
+    virtual size_t frameCount() const = 0;
+};
+
+/// Decodes a video file with OpenCV
+class HCMVideoFileFrameSource : public I_HCMFrameSource
+{
+public:
+    explicit HCMVideoFileFrameSource(const std::string &path);
+
+    bool isOpened() const override;
+    bool read(cv::Mat &frame) override;
+    int width() const override;
+    int height() const override;
+    double fps() const override;
+    size_t frameCount() const override;
+
+    /// Continues reading at the given frame
+    bool seek(size_t frameNr);
+
+private:
+    cv::VideoCapture m_capture;
+};
+
+#endif // HCMLAB_FRAMESOURCE_H
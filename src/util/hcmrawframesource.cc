@@ -0,0 +1,212 @@
+#include "hcmrawframesource.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "mediapipe/framework/port/opencv_imgproc_inc.h"
+
+#include "hcmutils.h"
+
+static const std::string UNIX_SOCKET_PREFIX = "unix:";
+
+bool parseRawPixelFormat(const std::string &name, HCMRawPixelFormat &format)
+{
+    if (name == "bgr24")
+        format = HCMRawPixelFormat::BGR24;
+    else if (name == "gray8")
+        format = HCMRawPixelFormat::GRAY8;
+    else
+        return false;
+    return true;
+}
+
+/// @returns a file descriptor connected to the Unix domain stream socket at socketPath, or -1
+static int connectUnixSocket(const std::string &socketPath)
+{
+    sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (socketPath.size() >= sizeof(address.sun_path))
+    {
+        hcmutils::logError("Socket path is too long: " + socketPath);
+        return -1;
+    }
+    std::strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+    {
+        return -1;
+    }
+    if (connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+HCMRawFrameSource::HCMRawFrameSource(const std::string &path, HCMRawPixelFormat format, int width, int height, double fps) :
+    m_path(path),
+    m_format(format),
+    m_width(width),
+    m_height(height),
+    m_fps(fps),
+    m_fd(-1),
+    m_ownsFd(true)
+{
+    if (m_width <= 0 || m_height <= 0)
+    {
+        hcmutils::logError("Raw frames need a width and height");
+        return;
+    }
+
+    if (path == "-")
+    {
+        m_fd = STDIN_FILENO;
+        m_ownsFd = false;
+    }
+    else if (path.compare(0, UNIX_SOCKET_PREFIX.size(), UNIX_SOCKET_PREFIX) == 0)
+    {
+        m_fd = connectUnixSocket(path.substr(UNIX_SOCKET_PREFIX.size()));
+    }
+    else
+    {
+        m_fd = open(path.c_str(), O_RDONLY); // blocks until the writer of a FIFO has opened it
+    }
+
+    if (m_fd < 0)
+    {
+        hcmutils::logError("Could not open " + path + ": " + std::strerror(errno));
+        return;
+    }
+
+#ifdef F_SETPIPE_SZ
+    // a pipe holds 64KiB by default, so a single frame takes many wake ups of this thread and the writer.
+    // Try to make room for a whole frame, which fails without harm for files, sockets and above the system's limit
+    struct stat fileStatus;
+    if (fstat(m_fd, &fileStatus) == 0 && S_ISFIFO(fileStatus.st_mode))
+    {
+        size_t frameSize = static_cast<size_t>(m_width) * m_height * (m_format == HCMRawPixelFormat::BGR24 ? 3 : 1);
+        fcntl(m_fd, F_SETPIPE_SZ, static_cast<int>(std::min<size_t>(frameSize, 1 << 20)));
+    }
+#endif
+
+    if (m_format == HCMRawPixelFormat::GRAY8)
+    {
+        m_grayFrame.create(m_height, m_width, CV_8UC1);
+    }
+}
+
+HCMRawFrameSource::~HCMRawFrameSource()
+{
+    if (m_fd >= 0 && m_ownsFd)
+    {
+        close(m_fd);
+    }
+}
+
+bool HCMRawFrameSource::isOpened() const
+{
+    return m_fd >= 0;
+}
+
+bool HCMRawFrameSource::read(cv::Mat &frame)
+{
+    if (m_fd < 0)
+    {
+        return false;
+    }
+
+    frame.create(m_height, m_width, CV_8UC3); // only allocates if frame isn't one of the reader's preallocated slots
+
+    // a continuous Mat is read in one go. A slot the caller passed in may be a view into a larger Mat instead,
+    // whose rows have gaps between them, so it is read row by row
+    cv::Mat &target = m_format == HCMRawPixelFormat::GRAY8 ? m_grayFrame : frame;
+    size_t frameSize = target.total() * target.elemSize();
+    size_t bytesRead = 0;
+    if (target.isContinuous())
+    {
+        bytesRead = readFully(target.data, frameSize);
+    }
+    else
+    {
+        size_t rowSize = target.cols * target.elemSize();
+        for (int row = 0; row < target.rows; row++)
+        {
+            size_t rowBytesRead = readFully(target.ptr(row), rowSize);
+            bytesRead += rowBytesRead;
+            if (rowBytesRead < rowSize)
+            {
+                break;
+            }
+        }
+    }
+    if (bytesRead < frameSize)
+    {
+        if (bytesRead > 0)
+        {
+            hcmutils::logError("Dropped the last frame of " + m_path + ", the input ended in the middle of it");
+        }
+        return false;
+    }
+
+    if (m_format == HCMRawPixelFormat::GRAY8)
+    {
+        cv::cvtColor(m_grayFrame, frame, cv::COLOR_GRAY2BGR);
+    }
+    return true;
+}
+
+size_t HCMRawFrameSource::readFully(uchar *data, size_t size)
+{
+    size_t bytesRead = 0;
+    while (bytesRead < size)
+    {
+        ssize_t result = ::read(m_fd, data + bytesRead, size - bytesRead);
+        if (result > 0)
+        {
+            bytesRead += static_cast<size_t>(result);
+        }
+        else if (result < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        else
+        {
+            if (result < 0)
+            {
+                hcmutils::logError("Could not read from " + m_path + ": " + std::strerror(errno));
+            }
+            break; // end of input
+        }
+    }
+    return bytesRead;
+}
+
+int HCMRawFrameSource::width() const
+{
+    return m_width;
+}
+
+int HCMRawFrameSource::height() const
+{
+    return m_height;
+}
+
+double HCMRawFrameSource::fps() const
+{
+    return m_fps;
+}
+
+size_t HCMRawFrameSource::frameCount() const
+{
+    return 0;
+}
@@ -0,0 +1,61 @@
+#ifndef HCMLAB_RAWFRAMESOURCE_H
+#define HCMLAB_RAWFRAMESOURCE_H
+
+#include <string>
+
+#include "hcmframesource.h"
+
+/// Pixel layout of uncompressed frames
+enum class HCMRawPixelFormat
+{
+    BGR24, // 3 bytes per pixel in blue, green, red order (ffmpeg's 'bgr24')
+    GRAY8  // 1 byte per pixel (ffmpeg's 'gray')
+};
+
+/// Parses "bgr24" or "gray8"
+bool parseRawPixelFormat(const std::string &name, HCMRawPixelFormat &format);
+
+/**
+ * Reads uncompressed frames of a declared size and pixel format, that follow each other without any header or padding,
+ * e.g. the output of 'ffmpeg ... -f rawvideo -pix_fmt bgr24 -'. The frames can come from:
+ *      "-"                         stdin
+ *      "unix:/path/to/socket"      a Unix domain stream socket, which is connected to
+ *      any other path              a named pipe (FIFO) or a file
+ *
+ * The bytes of BGR24 frames are read straight into the frame's buffer, GRAY8 frames are read into a preallocated buffer
+ * and expanded to BGR from there. No frame is decoded or allocated after the first one.
+ * The input ends when the writer closes its end, a truncated last frame is dropped.
+ */
+class HCMRawFrameSource : public I_HCMFrameSource
+{
+public:
+    HCMRawFrameSource(const std::string &path, HCMRawPixelFormat format, int width, int height, double fps);
+    ~HCMRawFrameSource();
+
+    HCMRawFrameSource(const HCMRawFrameSource &) = delete;
+    HCMRawFrameSource &operator=(const HCMRawFrameSource &) = delete;
+
+    bool isOpened() const override;
+    bool read(cv::Mat &frame) override;
+    int width() const override;
+    int height() const override;
+    double fps() const override;
+    size_t frameCount() const override;
+
+private:
+    /// Reads exactly size bytes, unless the input ends or fails first
+    /// @returns the number of bytes read
+    size_t readFully(uchar *data, size_t size);
+
+    std::string m_path;
+    HCMRawPixelFormat m_format;
+    int m_width;
+    int m_height;
+    double m_fps;
+
+    int m_fd;        // -1 if the input could not be opened
+    bool m_ownsFd;   // stdin is not closed
+    cv::Mat m_grayFrame;
+};
+
+#endif // HCMLAB_RAWFRAMESOURCE_H
@@ -0,0 +1,279 @@
+#include "hcmstagetimer.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "hcmutils.h"
+
+/*
+ * Log-linear histogram of latencies in nanoseconds: values below 16 have a bucket each, above that every power of two
+ * is split into 16 buckets. So every bucket is at most 1/16 (6.25%) of its value wide, up to 2^40ns (~18 minutes).
+ */
+static const int SUB_BUCKET_BITS = 4;
+static const int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+static const int MAX_EXPONENT = 40;
+static const int NR_OF_BUCKETS = SUB_BUCKETS + (MAX_EXPONENT - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+static const int NR_OF_STAGES = static_cast<int>(HCMStage::NR_OF_STAGES);
+
+static int bucketOf(uint64_t nanoseconds)
+{
+    if (nanoseconds < SUB_BUCKETS)
+        return static_cast<int>(nanoseconds);
+
+    int exponent = 63;
+    while (!(nanoseconds >> exponent))
+        exponent--;
+    if (exponent > MAX_EXPONENT)
+        return NR_OF_BUCKETS - 1;
+
+    int subBucket = static_cast<int>(nanoseconds >> (exponent - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1);
+    return SUB_BUCKETS + (exponent - SUB_BUCKET_BITS) * SUB_BUCKETS + subBucket;
+}
+
+/// the middle of the range of values of a bucket
+static double bucketValue(int bucket)
+{
+    if (bucket < SUB_BUCKETS)
+        return bucket;
+
+    int exponent = (bucket - SUB_BUCKETS) / SUB_BUCKETS + SUB_BUCKET_BITS;
+    int subBucket = (bucket - SUB_BUCKETS) % SUB_BUCKETS;
+    double width = static_cast<double>(uint64_t(1) << (exponent - SUB_BUCKET_BITS));
+    return (SUB_BUCKETS + subBucket) * width + 0.5 * width;
+}
+
+/// The histograms of one thread. Only that thread writes them, writeSummary() may read them at any time
+struct ThreadHistograms
+{
+    std::array<std::array<std::atomic<uint64_t>, NR_OF_BUCKETS>, NR_OF_STAGES> counts;
+    std::array<std::atomic<uint64_t>, NR_OF_STAGES> sums;
+    std::array<std::atomic<uint64_t>, NR_OF_STAGES> maxima;
+
+    ThreadHistograms()
+    {
+        for (auto &stageCounts : counts)
+            for (auto &count : stageCounts)
+                count.store(0, std::memory_order_relaxed);
+        for (int stage = 0; stage < NR_OF_STAGES; stage++)
+        {
+            sums[stage].store(0, std::memory_order_relaxed);
+            maxima[stage].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    // single writer, so a plain load and store is enough to keep the values consistent
+    static void add(std::atomic<uint64_t> &value, uint64_t summand)
+    {
+        value.store(value.load(std::memory_order_relaxed) + summand, std::memory_order_relaxed);
+    }
+};
+
+// The histograms of all threads that ever recorded a latency. Threads that end hand theirs back to be reused
+// by the next new thread (e.g. the frame reader of the next video), their latencies are kept.
+static std::mutex registryMutex;
+static std::vector<std::unique_ptr<ThreadHistograms>> registry;
+static std::vector<ThreadHistograms *> unusedHistograms;
+
+namespace
+{
+    struct ThreadHistogramsOwner
+    {
+        ThreadHistograms *histograms = nullptr;
+
+        ~ThreadHistogramsOwner()
+        {
+            if (histograms)
+            {
+                std::lock_guard<std::mutex> lock(registryMutex);
+                unusedHistograms.push_back(histograms);
+            }
+        }
+    };
+} // namespace
+
+static ThreadHistograms &threadHistograms()
+{
+    thread_local ThreadHistogramsOwner owner;
+    if (!owner.histograms)
+    {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        if (!unusedHistograms.empty())
+        {
+            owner.histograms = unusedHistograms.back();
+            unusedHistograms.pop_back();
+        }
+        else
+        {
+            registry.push_back(std::unique_ptr<ThreadHistograms>(new ThreadHistograms()));
+            owner.histograms = registry.back().get();
+        }
+    }
+    return *owner.histograms;
+}
+
+namespace hcmstagetimer
+{
+    namespace detail
+    {
+        std::atomic<bool> enabled(false);
+    }
+
+    const char *stageName(HCMStage stage)
+    {
+        switch (stage)
+        {
+        case HCMStage::DECODE:
+            return "decode";
+        case HCMStage::PUSH_FRAME_INTO_GRAPH:
+            return "push_frame_into_graph";
+        case HCMStage::LANDMARK_WAIT:
+            return "landmark_wait";
+        case HCMStage::RENDER_CROPPED_EYE_FRAME:
+            return "render_cropped_eye_frame";
+        case HCMStage::OPTIMIZE_IMAGE:
+            return "optimize_image";
+        case HCMStage::PUPIL_DETECTION:
+            return "pupil_detection";
+        case HCMStage::PUPIL_TRACKING:
+            return "pupil_tracking";
+        case HCMStage::DEBUG_RENDERING:
+            return "debug_rendering";
+        case HCMStage::OUTPUT_WRITING:
+            return "output_writing";
+        default:
+            return "unknown";
+        }
+    }
+
+    void enable()
+    {
+        detail::enabled.store(true, std::memory_order_relaxed);
+    }
+
+    void record(HCMStage stage, std::chrono::steady_clock::duration duration)
+    {
+        int stageIndex = static_cast<int>(stage);
+        if (stageIndex < 0 || stageIndex >= NR_OF_STAGES)
+            return;
+
+        uint64_t nanoseconds = static_cast<uint64_t>(std::max<long long>(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count(), 0));
+        ThreadHistograms &histograms = threadHistograms();
+        ThreadHistograms::add(histograms.counts[stageIndex][bucketOf(nanoseconds)], 1);
+        ThreadHistograms::add(histograms.sums[stageIndex], nanoseconds);
+        if (nanoseconds > histograms.maxima[stageIndex].load(std::memory_order_relaxed))
+            histograms.maxima[stageIndex].store(nanoseconds, std::memory_order_relaxed);
+    }
+
+    struct StageSummary
+    {
+        uint64_t count = 0;
+        double meanMs = 0, p50Ms = 0, p95Ms = 0, p99Ms = 0, maxMs = 0;
+    };
+
+    static std::vector<StageSummary> summarize()
+    {
+        std::vector<std::vector<uint64_t>> counts(NR_OF_STAGES, std::vector<uint64_t>(NR_OF_BUCKETS, 0));
+        std::vector<uint64_t> sums(NR_OF_STAGES, 0);
+        std::vector<uint64_t> maxima(NR_OF_STAGES, 0);
+        {
+            std::lock_guard<std::mutex> lock(registryMutex);
+            for (const auto &histograms : registry)
+            {
+                for (int stage = 0; stage < NR_OF_STAGES; stage++)
+                {
+                    for (int bucket = 0; bucket < NR_OF_BUCKETS; bucket++)
+                        counts[stage][bucket] += histograms->counts[stage][bucket].load(std::memory_order_relaxed);
+                    sums[stage] += histograms->sums[stage].load(std::memory_order_relaxed);
+                    maxima[stage] = std::max(maxima[stage], histograms->maxima[stage].load(std::memory_order_relaxed));
+                }
+            }
+        }
+
+        std::vector<StageSummary> summaries(NR_OF_STAGES);
+        for (int stage = 0; stage < NR_OF_STAGES; stage++)
+        {
+            StageSummary &summary = summaries[stage];
+            for (uint64_t count : counts[stage])
+                summary.count += count;
+            if (summary.count == 0)
+                continue;
+
+            summary.meanMs = 1e-6 * sums[stage] / summary.count;
+            summary.maxMs = 1e-6 * maxima[stage];
+
+            // the value of the bucket that contains the n-th smallest latency, but never more than the maximum
+            auto percentile = [&](double p) {
+                uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(p * summary.count + 0.5));
+                uint64_t seen = 0;
+                for (int bucket = 0; bucket < NR_OF_BUCKETS; bucket++)
+                {
+                    seen += counts[stage][bucket];
+                    if (seen >= rank)
+                        return std::min(1e-6 * bucketValue(bucket), summary.maxMs);
+                }
+                return summary.maxMs;
+            };
+            summary.p50Ms = percentile(0.5);
+            summary.p95Ms = percentile(0.95);
+            summary.p99Ms = percentile(0.99);
+        }
+        return summaries;
+    }
+
+    bool writeSummary(const std::string &path)
+    {
+        std::ofstream file(path);
+        if (!file.is_open())
+        {
+            hcmutils::logError("Could not open " + path);
+            return false;
+        }
+
+        std::vector<StageSummary> summaries = summarize();
+        bool json = path.size() >= 5 && path.compare(path.size() - 5, 5, ".json") == 0;
+
+        if (json)
+        {
+            file << "{\n    \"stages\": [\n";
+        }
+        else
+        {
+            file << "stage,count,mean_ms,p50_ms,p95_ms,p99_ms,max_ms\n";
+        }
+
+        for (int stage = 0; stage < NR_OF_STAGES; stage++)
+        {
+            const StageSummary &summary = summaries[stage];
+            const char *name = stageName(static_cast<HCMStage>(stage));
+            if (json)
+            {
+                file << "        {"
+                     << "\"stage\": \"" << name << "\", "
+                     << "\"count\": " << summary.count << ", "
+                     << "\"mean_ms\": " << summary.meanMs << ", "
+                     << "\"p50_ms\": " << summary.p50Ms << ", "
+                     << "\"p95_ms\": " << summary.p95Ms << ", "
+                     << "\"p99_ms\": " << summary.p99Ms << ", "
+                     << "\"max_ms\": " << summary.maxMs
+                     << "}" << (stage + 1 < NR_OF_STAGES ? "," : "") << "\n";
+            }
+            else
+            {
+                file << name << "," << summary.count << "," << summary.meanMs << "," << summary.p50Ms << ","
+                     << summary.p95Ms << "," << summary.p99Ms << "," << summary.maxMs << "\n";
+            }
+        }
+
+        if (json)
+        {
+            file << "    ]\n}\n";
+        }
+
+        return true;
+    }
+} // namespace hcmstagetimer
@@ -0,0 +1,98 @@
+#ifndef HCMLAB_STAGETIMER_H
+#define HCMLAB_STAGETIMER_H
+
+#include <atomic>
+#include <chrono>
+#include <string>
+
+#include "hcmtracerecorder.h"
+
+/// The stages of the tracking pipeline whose latencies are measured
+enum class HCMStage
+{
+    DECODE,                   // reading a frame from the input video
+    PUSH_FRAME_INTO_GRAPH,    // handing a frame to the face tracking graph
+    LANDMARK_WAIT,            // waiting for the face tracking graph's landmarks of a frame
+    RENDER_CROPPED_EYE_FRAME, // cropping an eye from a frame
+    OPTIMIZE_IMAGE,           // brightness and contrast enhancement of an eye
+    PUPIL_DETECTION,          // PupilTrackingMethod::track() when it has to detect the pupil from scratch
+    PUPIL_TRACKING,           // PupilTrackingMethod::track() when it tracks the pupil of the previous frame
+    DEBUG_RENDERING,          // drawing and writing the debug videos
+    OUTPUT_WRITING,           // writing the pupil data to the output files
+    NR_OF_STAGES
+};
+
+namespace hcmstagetimer
+{
+    namespace detail
+    {
+        extern std::atomic<bool> enabled;
+    }
+
+    /// Starts measuring. Until then all HCMStageTimers do nothing but check this flag
+    void enable();
+    inline bool isEnabled() { return detail::enabled.load(std::memory_order_relaxed); }
+
+    /// snake_case name of a stage, as used in the summary and the trace
+    const char *stageName(HCMStage stage);
+
+    /// Adds a latency to the calling thread's histogram of the stage. Takes no lock (except on the first call of a thread)
+    void record(HCMStage stage, std::chrono::steady_clock::duration duration);
+
+    /// Merges the histograms of all threads and writes count, mean, p50, p95, p99 and max (in milliseconds) of every stage.
+    /// @param path - a '.json' file, or a '.csv' file for any other extension
+    bool writeSummary(const std::string &path);
+} // namespace hcmstagetimer
+
+/**
+ * Measures the time from its construction to its destruction (or stop()) as latency of a stage.
+ * While a trace is recorded (see hcmtrace), the measurement is also added to the trace as a span of the stage:
+ * {
+ *      HCMStageTimer timer(HCMStage::OPTIMIZE_IMAGE);
+ *      ...work...
+ * }
+ */
+class HCMStageTimer
+{
+public:
+    explicit HCMStageTimer(HCMStage stage) : m_stage(stage), m_running(hcmstagetimer::isEnabled() || hcmtrace::isEnabled())
+    {
+        if (m_running)
+        {
+            m_start = std::chrono::steady_clock::now();
+        }
+    }
+
+    ~HCMStageTimer() { stop(); }
+
+    HCMStageTimer(const HCMStageTimer &) = delete;
+    HCMStageTimer &operator=(const HCMStageTimer &) = delete;
+
+    /// For work whose stage is only known at its end, e.g. whether the pupil was detected or tracked
+    void setStage(HCMStage stage) { m_stage = stage; }
+
+    /// Ends the measurement before the timer goes out of scope
+    void stop()
+    {
+        if (m_running)
+        {
+            auto end = std::chrono::steady_clock::now();
+            if (hcmstagetimer::isEnabled())
+            {
+                hcmstagetimer::record(m_stage, end - m_start);
+            }
+            if (hcmtrace::isEnabled())
+            {
+                hcmtrace::recordSpan(hcmstagetimer::stageName(m_stage), m_start, end);
+            }
+            m_running = false;
+        }
+    }
+
+private:
+    HCMStage m_stage;
+    bool m_running;
+    std::chrono::steady_clock::time_point m_start;
+};
+
+#endif // HCMLAB_STAGETIMER_H
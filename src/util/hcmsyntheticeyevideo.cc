@@ -0,0 +1,262 @@
+#include "hcmsyntheticeyevideo.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <vector>
+
+#include "hcmutils.h"
+
+#include "mediapipe/framework/port/opencv_imgproc_inc.h"
+#include "mediapipe/framework/port/opencv_video_inc.h"
+
+// gray values of the rendered infrared image
+static const int BACKGROUND_GRAY = 40;
+static const int SKIN_GRAY = 150;
+static const int SCLERA_GRAY = 195;
+static const int IRIS_GRAY = 110;
+static const int PUPIL_GRAY = 25;
+static const int GLINT_GRAY = 250;
+static const int EYELASHES_GRAY = 70;
+
+static const double BLINK_DURATION = 0.2;        // in seconds
+static const double MAX_CONSTRICTION_TIME = 0.3; // in seconds, of the light reflex
+
+bool parsePupilDilationCurve(const std::string &name, PupilDilationCurve &curve)
+{
+    if (name == "constant")
+        curve = PupilDilationCurve::CONSTANT;
+    else if (name == "sine")
+        curve = PupilDilationCurve::SINE;
+    else if (name == "light_reflex")
+        curve = PupilDilationCurve::LIGHT_REFLEX;
+    else if (name == "random_walk")
+        curve = PupilDilationCurve::RANDOM_WALK;
+    else
+        return false;
+    return true;
+}
+
+HCMSyntheticEyeVideo::HCMSyntheticEyeVideo(const SyntheticEyeVideoConfig &config) : m_config(config)
+{
+    m_config.width = std::max(m_config.width, 16);
+    m_config.height = std::max(m_config.height, 16);
+    m_config.fps = m_config.fps > 0 ? m_config.fps : 30;
+    m_config.maxPupilDiameter = std::max(m_config.minPupilDiameter, m_config.maxPupilDiameter);
+    m_config.nrOfGlints = std::max(m_config.nrOfGlints, 0);
+    m_config.eyelidOcclusion = std::min(std::max(m_config.eyelidOcclusion, 0.0f), 1.0f);
+
+    rewind();
+}
+
+void HCMSyntheticEyeVideo::rewind()
+{
+    m_rng = cv::RNG(m_config.seed);
+    m_nextFrameNr = 0;
+    m_pupilDiameter = 0;
+    m_randomWalkDiameter = 0.5f * (m_config.minPupilDiameter + m_config.maxPupilDiameter);
+    m_gaze = cv::Point2f(0, 0);
+}
+
+float HCMSyntheticEyeVideo::dilatedPupilDiameter(double seconds)
+{
+    float minDiameter = m_config.minPupilDiameter;
+    float maxDiameter = m_config.maxPupilDiameter;
+    double period = std::max(m_config.dilationPeriod, 1e-3);
+
+    switch (m_config.dilationCurve)
+    {
+    case PupilDilationCurve::SINE:
+        return minDiameter + 0.5f * (maxDiameter - minDiameter) * (1 + std::sin(2 * CV_PI * seconds / period));
+    case PupilDilationCurve::LIGHT_REFLEX:
+    {
+        double phase = std::fmod(seconds, period);
+        double constrictionTime = std::min(MAX_CONSTRICTION_TIME, 0.25 * period);
+        if (phase < constrictionTime)
+            return maxDiameter - (maxDiameter - minDiameter) * phase / constrictionTime;
+        return minDiameter + (maxDiameter - minDiameter) * (1 - std::exp(-(phase - constrictionTime) / (0.25 * period)));
+    }
+    case PupilDilationCurve::RANDOM_WALK:
+    {
+        // about one full range per dilationPeriod
+        float step = (maxDiameter - minDiameter) / std::sqrt(period * m_config.fps);
+        m_randomWalkDiameter += m_rng.gaussian(step);
+        m_randomWalkDiameter = std::min(std::max(m_randomWalkDiameter, minDiameter), maxDiameter);
+        return m_randomWalkDiameter;
+    }
+    case PupilDilationCurve::CONSTANT:
+    default:
+        return 0.5f * (minDiameter + maxDiameter);
+    }
+}
+
+void HCMSyntheticEyeVideo::renderEye(cv::Mat &eye, float pupilDiameter, const cv::Point2f &gaze, float eyelidClosure)
+{
+    cv::Point2f eyeCenter(0.5f * eye.cols, 0.5f * eye.rows);
+    cv::Size eyeAxes(cvRound(0.45f * eye.cols), cvRound(0.36f * eye.rows));
+
+    eye.setTo(cv::Scalar(SKIN_GRAY));
+    cv::ellipse(eye, eyeCenter, eyeAxes, 0, 0, 360, cv::Scalar(SCLERA_GRAY), cv::FILLED, cv::LINE_AA);
+
+    cv::Point2f irisCenter = eyeCenter + gaze;
+    float irisRadius = std::max(0.3f * std::min<float>(eye.cols, 1.33f * eye.rows), 0.6f * pupilDiameter);
+    cv::circle(eye, irisCenter, cvRound(irisRadius), cv::Scalar(IRIS_GRAY), cv::FILLED, cv::LINE_AA);
+
+    // slightly elliptical, as the eye is never seen exactly head-on
+    cv::RotatedRect pupil(irisCenter, cv::Size2f(pupilDiameter, 0.92f * pupilDiameter), 20);
+    cv::ellipse(eye, pupil, cv::Scalar(PUPIL_GRAY), cv::FILLED, cv::LINE_AA);
+
+    int glintRadius = std::max(1, cvRound(0.015f * eye.cols));
+    for (int i = 0; i < m_config.nrOfGlints; i++)
+    {
+        double angle = 2 * CV_PI * i / m_config.nrOfGlints - 0.25 * CV_PI;
+        cv::Point2f offset(std::cos(angle), std::sin(angle));
+        cv::circle(eye, irisCenter + 0.3f * pupilDiameter * offset, glintRadius, cv::Scalar(GLINT_GRAY), cv::FILLED, cv::LINE_AA);
+    }
+
+    // upper eyelid: covers the top of the pupil and closes completely while blinking
+    float eyeTop = eyeCenter.y - eyeAxes.height;
+    float eyeBottom = eyeCenter.y + eyeAxes.height;
+    float openLid = eyeTop;
+    if (m_config.eyelidOcclusion > 0)
+        openLid = irisCenter.y - 0.5f * pupilDiameter + m_config.eyelidOcclusion * pupilDiameter;
+    float lid = openLid + eyelidClosure * (eyeBottom - openLid);
+
+    std::vector<cv::Point> lidOutline;
+    const int nrOfLidPoints = 16;
+    for (int i = 0; i <= nrOfLidPoints; i++)
+    {
+        float x = static_cast<float>(i) * eye.cols / nrOfLidPoints;
+        float fromCenter = (x - eyeCenter.x) / (0.5f * eye.cols);
+        lidOutline.emplace_back(cvRound(x), cvRound(lid + 0.25f * eye.rows * fromCenter * fromCenter));
+    }
+    cv::polylines(eye, lidOutline, false, cv::Scalar(EYELASHES_GRAY), std::max(1, eye.cols / 100), cv::LINE_AA);
+    lidOutline.emplace_back(eye.cols, 0);
+    lidOutline.emplace_back(0, 0);
+    cv::fillPoly(eye, std::vector<std::vector<cv::Point>>{lidOutline}, cv::Scalar(SKIN_GRAY), cv::LINE_AA);
+}
+
+bool HCMSyntheticEyeVideo::read(cv::Mat &frame)
+{
+    if (m_nextFrameNr >= m_config.nrOfFrames)
+        return false;
+
+    double seconds = m_nextFrameNr / m_config.fps;
+    float pupilDiameter = dilatedPupilDiameter(seconds);
+
+    // small fixational eye movements around the center of the eye
+    m_gaze += cv::Point2f(m_rng.gaussian(0.3), m_rng.gaussian(0.3));
+    float gazeDistance = std::sqrt(m_gaze.dot(m_gaze));
+    if (gazeDistance > m_config.gazeJitter)
+        m_gaze *= gazeDistance > 0 ? m_config.gazeJitter / gazeDistance : 0;
+
+    float eyelidClosure = 0;
+    if (m_config.blinkInterval > 0)
+    {
+        double phase = std::fmod(seconds, m_config.blinkInterval);
+        if (phase < BLINK_DURATION)
+            eyelidClosure = std::sin(CV_PI * phase / BLINK_DURATION);
+    }
+
+    m_gray.create(m_config.height, m_config.width, CV_8U);
+    if (!m_config.fullFace)
+    {
+        renderEye(m_gray, pupilDiameter, m_gaze, eyelidClosure);
+        m_pupilDiameter = pupilDiameter;
+    }
+    else
+    {
+        int width = m_config.width;
+        int height = m_config.height;
+        m_gray.setTo(cv::Scalar(BACKGROUND_GRAY));
+        cv::ellipse(m_gray, cv::Point(width / 2, cvRound(0.55 * height)), cv::Size(cvRound(0.33 * width), cvRound(0.48 * height)),
+                    0, 0, 360, cv::Scalar(SKIN_GRAY), cv::FILLED, cv::LINE_AA);
+        // nose and mouth
+        cv::line(m_gray, cv::Point(width / 2, cvRound(0.45 * height)), cv::Point(cvRound(0.48 * width), cvRound(0.65 * height)), cv::Scalar(120), std::max(1, width / 150), cv::LINE_AA);
+        cv::ellipse(m_gray, cv::Point(width / 2, cvRound(0.78 * height)), cv::Size(cvRound(0.1 * width), cvRound(0.03 * height)),
+                    0, 0, 180, cv::Scalar(90), std::max(1, width / 150), cv::LINE_AA);
+
+        // both eyes are rendered like a single eye crop, just smaller
+        int eyeWidth = cvRound(0.22 * width);
+        int eyeHeight = cvRound(0.75 * eyeWidth);
+        float scale = static_cast<float>(eyeWidth) / width;
+        cv::Rect frameRect(0, 0, width, height);
+        for (double eyeCenterX : {0.36 * width, 0.64 * width})
+        {
+            cv::Rect eyeRect(cvRound(eyeCenterX - 0.5 * eyeWidth), cvRound(0.42 * height - 0.5 * eyeHeight), eyeWidth, eyeHeight);
+            eyeRect &= frameRect;
+            if (eyeRect.area() == 0)
+                continue;
+            cv::Mat eye = m_gray(eyeRect);
+            renderEye(eye, scale * pupilDiameter, scale * m_gaze, eyelidClosure);
+        }
+        m_pupilDiameter = scale * pupilDiameter;
+    }
+
+    if (m_config.blurSigma > 0)
+    {
+        cv::GaussianBlur(m_gray, m_blurred, cv::Size(0, 0), m_config.blurSigma);
+        std::swap(m_gray, m_blurred);
+    }
+    if (m_config.noiseSigma > 0)
+    {
+        m_noise.create(m_gray.size(), CV_16S);
+        m_rng.fill(m_noise, cv::RNG::NORMAL, 0, m_config.noiseSigma);
+        cv::add(m_gray, m_noise, m_blurred, cv::noArray(), CV_8U);
+        std::swap(m_gray, m_blurred);
+    }
+
+    cv::cvtColor(m_gray, frame, cv::COLOR_GRAY2BGR);
+    m_nextFrameNr++;
+    return true;
+}
+
+bool HCMSyntheticEyeVideo::write(const std::string &videoPath, const std::string &groundTruthPath)
+{
+    cv::VideoWriter videoWriter(videoPath, mediapipe::fourcc('a', 'v', 'c', '1'), // .mp4
+                                m_config.fps, cv::Size(m_config.width, m_config.height));
+    if (!videoWriter.isOpened())
+    {
+        hcmutils::logError("Could not open " + videoPath);
+        return false;
+    }
+
+    std::ofstream groundTruthFile(groundTruthPath);
+    if (!groundTruthFile.is_open())
+    {
+        hcmutils::logError("Could not open " + groundTruthPath);
+        return false;
+    }
+    groundTruthFile << "frame,pupil_diameter\n";
+
+    rewind();
+    cv::Mat frame;
+    while (read(frame))
+    {
+        videoWriter.write(frame);
+        groundTruthFile << frameNr() << "," << pupilDiameter() << "\n";
+    }
+    rewind();
+
+    return true;
+}
+
+cv::Mat renderSyntheticEyeCrop(const cv::Size &size, unsigned int seed)
+{
+    SyntheticEyeVideoConfig config;
+    float scale = static_cast<float>(size.width) / config.width;
+    config.width = size.width;
+    config.height = size.height;
+    config.nrOfFrames = 1;
+    config.minPupilDiameter *= scale;
+    config.maxPupilDiameter *= scale;
+    config.dilationCurve = PupilDilationCurve::CONSTANT;
+    config.gazeJitter *= scale;
+    config.seed = seed;
+
+    HCMSyntheticEyeVideo video(config);
+    cv::Mat frame, crop;
+    video.read(frame);
+    cv::cvtColor(frame, crop, cv::COLOR_BGR2GRAY);
+    return crop;
+}
@@ -0,0 +1,107 @@
+#ifndef HCMLAB_SYNTHETICEYEVIDEO_H
+#define HCMLAB_SYNTHETICEYEVIDEO_H
+
+#include <string>
+
+#include "mediapipe/framework/port/opencv_core_inc.h"
+
+/// How the diameter of the rendered pupil changes over time
+enum class PupilDilationCurve
+{
+    CONSTANT,     // halfway between the minimum and maximum diameter
+    SINE,         // oscillates between the minimum and maximum diameter once per dilationPeriod
+    LIGHT_REFLEX, // constricts quickly to the minimum at the start of every dilationPeriod and slowly dilates back
+    RANDOM_WALK   // drifts randomly between the minimum and maximum diameter
+};
+
+/// Parses "constant", "sine", "light_reflex" or "random_walk"
+bool parsePupilDilationCurve(const std::string &name, PupilDilationCurve &curve);
+
+struct SyntheticEyeVideoConfig
+{
+    int width = 192;
+    int height = 144;
+    double fps = 30;
+    size_t nrOfFrames = 600;
+
+    /// Renders two eyes into a face-like frame instead of a single eye crop (as recorded by an eye-tracker).
+    /// Mediapipe's face tracking does not necessarily recognize the drawn face.
+    bool fullFace = false;
+
+    /// Pupil diameters in pixels of a single eye crop of the configured size. Scaled to the eyes of full face frames.
+    float minPupilDiameter = 24;
+    float maxPupilDiameter = 48;
+    PupilDilationCurve dilationCurve = PupilDilationCurve::SINE;
+    double dilationPeriod = 4; // in seconds
+
+    int nrOfGlints = 1;       // corneal reflections of point lights
+    float eyelidOcclusion = 0; // fraction of the pupil's diameter covered by the upper eyelid while the eye is open
+    double blinkInterval = 0; // in seconds, 0 disables blinking
+    float gazeJitter = 2;     // how far (in pixels) the pupil wanders from the center of the eye
+    float blurSigma = 1;      // defocus
+    float noiseSigma = 4;     // sensor noise
+
+    unsigned int seed = 1;
+};
+
+/**
+ * Renders infrared-like videos of eyes with a dark elliptical pupil of known diameter, to benchmark and check the pupil
+ * tracking without any recorded footage.
+ *
+ * Acts as an in-memory frame source, like a cv::VideoCapture:
+ * HCMSyntheticEyeVideo video(config);
+ *
+ * cv::Mat frame;
+ * while (video.read(frame)) {
+ *      ...use frame and video.pupilDiameter()...
+ * }
+ *
+ * The same config (including its seed) renders the same frames on every machine.
+ */
+class HCMSyntheticEyeVideo
+{
+public:
+    explicit HCMSyntheticEyeVideo(const SyntheticEyeVideoConfig &config);
+
+    /// Renders the next frame as BGR image
+    /// @returns false once all frames of the video were rendered
+    bool read(cv::Mat &frame);
+
+    /// @returns the true pupil diameter (the major axis of the pupil ellipse) in pixels of the frame last returned by read()
+    float pupilDiameter() const { return m_pupilDiameter; }
+
+    /// @returns the number of the frame last returned by read(), starting at 0
+    size_t frameNr() const { return m_nextFrameNr - 1; }
+
+    /// Starts the video over, with the same frames as before
+    void rewind();
+
+    /// Renders the whole video into an '.mp4' file and writes the true pupil diameter of each frame into a '.csv' file
+    bool write(const std::string &videoPath, const std::string &groundTruthPath);
+
+    const SyntheticEyeVideoConfig &config() const { return m_config; }
+
+private:
+    float dilatedPupilDiameter(double seconds);
+    void renderEye(cv::Mat &eye, float pupilDiameter, const cv::Point2f &gaze, float eyelidClosure);
+
+    SyntheticEyeVideoConfig m_config;
+    cv::RNG m_rng;
+
+    size_t m_nextFrameNr;
+    float m_pupilDiameter;
+    float m_randomWalkDiameter;
+    cv::Point2f m_gaze; // offset of the pupil from the center of the eye
+
+    cv::Mat m_gray;      // the frame before it is converted to BGR
+    cv::Mat m_noise;
+    cv::Mat m_blurred;
+};
+
+/**
+ * Renders a single gray (CV_8UC1) eye crop of the given size (at least 16x16 pixels), whose pupil diameter is scaled to the crop's width.
+ * A fixed input for the tests and benchmarks of the pupil detection, the same seed renders the same crop on every machine.
+ */
+cv::Mat renderSyntheticEyeCrop(const cv::Size &size, unsigned int seed);
+
+#endif // HCMLAB_SYNTHETICEYEVIDEO_H
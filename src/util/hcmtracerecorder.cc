@@ -0,0 +1,246 @@
+#include "hcmtracerecorder.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <vector>
+
+#include "hcmutils.h"
+
+struct TraceEvent
+{
+    const char *name;
+    int64_t frameNr;
+    int64_t beginNs; // since hcmtrace::start()
+    int64_t durationNs;
+    bool instant;
+};
+
+/// The ring buffer of one thread's events. Only that thread writes it, stop() reads it once recording has ended
+struct ThreadTrace
+{
+    int tid;
+    std::string name;
+    std::vector<TraceEvent> ring; // grows up to ringSize, then the oldest events are overwritten
+    uint64_t written = 0;         // number of events ever recorded into this buffer
+};
+
+static size_t ringSize = 0;
+static std::chrono::steady_clock::time_point traceStart;
+
+// The buffers of all threads that ever recorded an event. Threads that end hand theirs back to be reused
+// by the next thread of the same name, so a batch of videos doesn't create a new track per video and thread.
+static std::mutex registryMutex;
+static std::vector<std::unique_ptr<ThreadTrace>> registry;
+static std::vector<ThreadTrace *> unusedTraces;
+
+namespace
+{
+    struct ThreadTraceOwner
+    {
+        ThreadTrace *trace = nullptr;
+
+        ~ThreadTraceOwner()
+        {
+            if (trace)
+            {
+                std::lock_guard<std::mutex> lock(registryMutex);
+                unusedTraces.push_back(trace);
+            }
+        }
+    };
+} // namespace
+
+static thread_local ThreadTraceOwner owner;
+static thread_local int64_t threadCurrentFrame = hcmtrace::NO_FRAME;
+
+/// @param name - the name of the calling thread, an unused buffer of a thread with the same name is preferred
+static ThreadTrace *acquireThreadTrace(const std::string &name)
+{
+    std::lock_guard<std::mutex> lock(registryMutex);
+    auto unused = std::find_if(unusedTraces.begin(), unusedTraces.end(), [&](const ThreadTrace *trace) {
+        return trace->name == name;
+    });
+    if (unused != unusedTraces.end())
+    {
+        ThreadTrace *trace = *unused;
+        unusedTraces.erase(unused);
+        return trace;
+    }
+
+    registry.push_back(std::unique_ptr<ThreadTrace>(new ThreadTrace()));
+    ThreadTrace *trace = registry.back().get();
+    trace->tid = static_cast<int>(registry.size());
+    trace->name = name;
+    return trace;
+}
+
+static void addEvent(const TraceEvent &event)
+{
+    if (!owner.trace)
+    {
+        owner.trace = acquireThreadTrace("");
+    }
+
+    ThreadTrace &trace = *owner.trace;
+    if (trace.ring.size() < ringSize)
+    {
+        trace.ring.push_back(event);
+    }
+    else
+    {
+        trace.ring[trace.written % ringSize] = event;
+    }
+    trace.written++;
+}
+
+static int64_t nanosecondsSinceStart(std::chrono::steady_clock::time_point timePoint)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(timePoint - traceStart).count();
+}
+
+static std::string escapeJson(const std::string &text)
+{
+    std::string escaped;
+    for (char c : text)
+    {
+        if (c == '"' || c == '\\')
+        {
+            escaped += '\\';
+            escaped += c;
+        }
+        else if (static_cast<unsigned char>(c) < 0x20)
+        {
+            escaped += ' ';
+        }
+        else
+        {
+            escaped += c;
+        }
+    }
+    return escaped;
+}
+
+namespace hcmtrace
+{
+    namespace detail
+    {
+        std::atomic<bool> enabled(false);
+    }
+
+    void start(size_t eventsPerThread)
+    {
+        ringSize = std::max<size_t>(eventsPerThread, 1);
+        traceStart = std::chrono::steady_clock::now();
+        detail::enabled.store(true, std::memory_order_release);
+    }
+
+    void setThreadName(const std::string &name)
+    {
+        if (!isEnabled())
+        {
+            return;
+        }
+
+        if (!owner.trace)
+        {
+            owner.trace = acquireThreadTrace(name);
+        }
+        else if (owner.trace->name != name)
+        {
+            std::lock_guard<std::mutex> lock(registryMutex);
+            owner.trace->name = name;
+        }
+    }
+
+    void setCurrentFrame(int64_t frameNr)
+    {
+        threadCurrentFrame = frameNr;
+    }
+
+    int64_t currentFrame()
+    {
+        return threadCurrentFrame;
+    }
+
+    void recordSpan(const char *name, std::chrono::steady_clock::time_point begin, std::chrono::steady_clock::time_point end, int64_t frameNr)
+    {
+        if (!isEnabled())
+        {
+            return;
+        }
+        int64_t beginNs = nanosecondsSinceStart(begin);
+        addEvent({name, frameNr, beginNs, std::max<int64_t>(nanosecondsSinceStart(end) - beginNs, 0), false});
+    }
+
+    void recordInstant(const char *name, int64_t frameNr)
+    {
+        if (!isEnabled())
+        {
+            return;
+        }
+        addEvent({name, frameNr, nanosecondsSinceStart(std::chrono::steady_clock::now()), 0, true});
+    }
+
+    bool stop(const std::string &path)
+    {
+        detail::enabled.store(false, std::memory_order_release);
+
+        std::ofstream file(path);
+        if (!file.is_open())
+        {
+            hcmutils::logError("Could not open " + path);
+            return false;
+        }
+
+        std::lock_guard<std::mutex> lock(registryMutex);
+
+        file << std::fixed << std::setprecision(3);
+        file << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+        file << "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 0, \"args\": {\"name\": \"hcmlab_pupilsizetracking\"}}";
+
+        for (const auto &trace : registry)
+        {
+            std::string threadName = trace->name != "" ? trace->name : "thread " + std::to_string(trace->tid);
+            file << ",\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << trace->tid
+                 << ", \"args\": {\"name\": \"" << escapeJson(threadName) << "\"}}";
+
+            // the oldest event that was not overwritten yet comes first
+            size_t nrOfEvents = trace->ring.size();
+            size_t oldest = trace->written > nrOfEvents ? trace->written % nrOfEvents : 0;
+            for (size_t i = 0; i < nrOfEvents; i++)
+            {
+                const TraceEvent &event = trace->ring[(oldest + i) % nrOfEvents];
+                file << ",\n{\"name\": \"" << escapeJson(event.name) << "\", \"cat\": \"pipeline\", \"pid\": 1, \"tid\": " << trace->tid
+                     << ", \"ts\": " << event.beginNs / 1000.0;
+                if (event.instant)
+                {
+                    file << ", \"ph\": \"i\", \"s\": \"t\"";
+                }
+                else
+                {
+                    file << ", \"ph\": \"X\", \"dur\": " << event.durationNs / 1000.0;
+                }
+                if (event.frameNr != NO_FRAME)
+                {
+                    file << ", \"args\": {\"frame\": " << event.frameNr << "}";
+                }
+                file << "}";
+            }
+
+            if (trace->written > nrOfEvents)
+            {
+                std::ostringstream overwrittenStream;
+                overwrittenStream << "Trace: the oldest " << trace->written - nrOfEvents << " events of " << threadName
+                                  << " were overwritten, increase the trace buffer size to keep them";
+                hcmutils::logInfo(overwrittenStream.str());
+            }
+        }
+
+        file << "\n]}\n";
+        return true;
+    }
+} // namespace hcmtrace
@@ -0,0 +1,113 @@
+#ifndef HCMLAB_TRACERECORDER_H
+#define HCMLAB_TRACERECORDER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * Records a timeline of what each thread of the pipeline did for which frame and exports it as Chrome trace JSON,
+ * which can be opened in chrome://tracing or https://ui.perfetto.dev.
+ *
+ * hcmtrace::start(100000);
+ * hcmtrace::setThreadName("main");
+ * ...every HCMStageTimer, HCMTraceScope and hcmtrace::recordInstant() adds an event...
+ * hcmtrace::stop("trace.json");
+ *
+ * Every thread writes into its own fixed-size ring buffer without taking a lock, so long runs keep their latest events.
+ */
+namespace hcmtrace
+{
+    /// frame number of events that belong to no particular frame
+    const int64_t NO_FRAME = -1;
+
+    namespace detail
+    {
+        extern std::atomic<bool> enabled;
+    }
+
+    /// Starts recording. Until then all events are dropped after checking this flag
+    /// @param eventsPerThread - size of the ring buffer of each thread, older events are overwritten
+    void start(size_t eventsPerThread);
+    inline bool isEnabled() { return detail::enabled.load(std::memory_order_relaxed); }
+
+    /// Stops recording and writes the events of all threads to a Chrome trace JSON file.
+    /// Call it once the threads of the pipeline are done, their buffers are read without a lock
+    bool stop(const std::string &path);
+
+    /// Names the calling thread's track in the trace. Threads that ended hand their buffer to the next thread of the same name,
+    /// e.g. the frame reader of the next video continues the track of the previous one
+    void setThreadName(const std::string &name);
+
+    /// The frame that events of the calling thread belong to, unless they name one explicitly
+    void setCurrentFrame(int64_t frameNr);
+    int64_t currentFrame();
+
+    /// Adds an event spanning [begin, end] to the calling thread's track
+    /// @param name - must outlive the trace, e.g. a string literal
+    void recordSpan(const char *name, std::chrono::steady_clock::time_point begin, std::chrono::steady_clock::time_point end,
+                    int64_t frameNr = currentFrame());
+
+    /// Adds an event without duration to the calling thread's track, e.g. a timeout or the arrival of a packet
+    /// @param name - must outlive the trace, e.g. a string literal
+    void recordInstant(const char *name, int64_t frameNr = currentFrame());
+} // namespace hcmtrace
+
+/**
+ * Adds a span from its construction to its destruction to the trace:
+ * {
+ *      HCMTraceScope scope("track_frame", frameNr);
+ *      ...work, whose events belong to frame frameNr...
+ * }
+ */
+class HCMTraceScope
+{
+public:
+    explicit HCMTraceScope(const char *name) : m_name(name), m_running(hcmtrace::isEnabled()), m_setsFrame(false)
+    {
+        if (m_running)
+        {
+            m_frameNr = hcmtrace::currentFrame();
+            m_start = std::chrono::steady_clock::now();
+        }
+    }
+
+    /// Also makes frameNr the current frame of the calling thread until the scope ends
+    HCMTraceScope(const char *name, int64_t frameNr) : m_name(name), m_running(hcmtrace::isEnabled()), m_setsFrame(m_running)
+    {
+        if (m_running)
+        {
+            m_frameNr = frameNr;
+            m_previousFrameNr = hcmtrace::currentFrame();
+            hcmtrace::setCurrentFrame(frameNr);
+            m_start = std::chrono::steady_clock::now();
+        }
+    }
+
+    ~HCMTraceScope()
+    {
+        if (m_running)
+        {
+            hcmtrace::recordSpan(m_name, m_start, std::chrono::steady_clock::now(), m_frameNr);
+        }
+        if (m_setsFrame)
+        {
+            hcmtrace::setCurrentFrame(m_previousFrameNr);
+        }
+    }
+
+    HCMTraceScope(const HCMTraceScope &) = delete;
+    HCMTraceScope &operator=(const HCMTraceScope &) = delete;
+
+private:
+    const char *m_name;
+    bool m_running;
+    bool m_setsFrame;
+    int64_t m_frameNr = hcmtrace::NO_FRAME;
+    int64_t m_previousFrameNr = hcmtrace::NO_FRAME;
+    std::chrono::steady_clock::time_point m_start;
+};
+
+#endif // HCMLAB_TRACERECORDER_H
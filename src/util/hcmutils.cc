@@ -11,6 +11,7 @@
 #include <algorithm>
 #include <fstream>
 #include <sys/stat.h>
+#include <dirent.h>
 
 namespace hcmutils
 {
@@ -46,7 +47,11 @@ namespace hcmutils
     std::string extractFileNameFromPath(std::string path, const std::string &extension)
     {
         //remove extension
-        path.replace(path.find(extension), extension.length(), "");
+        auto extension_pos = path.rfind(extension);
+        if (extension_pos != std::string::npos)
+        {
+            path.replace(extension_pos, extension.length(), "");
+        }
 
         //remove path prefix
         auto last_slash_pos = path.find_last_of("/");
@@ -60,6 +65,60 @@ namespace hcmutils
         }
     }
 
+    /// returns the full paths of all files in dirPath whose name ends with extension, sorted alphabetically
+    std::vector<std::string> listFilesInDirectory(const std::string &dirPath, const std::string &extension)
+    {
+        std::vector<std::string> filePaths;
+
+        DIR *dir = opendir(dirPath.c_str());
+        if (dir == nullptr)
+        {
+            logError("Could not open directory " + dirPath);
+            return filePaths;
+        }
+
+        std::string dirPrefix = dirPath;
+        if (dirPrefix.back() != '/')
+        {
+            dirPrefix += "/";
+        }
+
+        while (dirent *entry = readdir(dir))
+        {
+            std::string fileName = entry->d_name;
+            if (fileName.length() > extension.length() &&
+                fileName.compare(fileName.length() - extension.length(), extension.length(), extension) == 0)
+            {
+                filePaths.push_back(dirPrefix + fileName);
+            }
+        }
+        closedir(dir);
+
+        std::sort(filePaths.begin(), filePaths.end());
+        return filePaths;
+    }
+
+    /// returns all non-empty lines of a text file
+    std::vector<std::string> readLinesFromFile(const std::string &filePath)
+    {
+        std::vector<std::string> lines;
+
+        std::ifstream file(filePath);
+        std::string line;
+        while (std::getline(file, line))
+        {
+            if (!line.empty() && line.back() == '\r')
+            {
+                line.pop_back();
+            }
+            if (!line.empty())
+            {
+                lines.push_back(line);
+            }
+        }
+        return lines;
+    }
+
     std::string getCurrentTimeString() {
         auto t = std::time(nullptr);
         auto tm = *std::localtime(&t);
@@ -14,6 +14,8 @@ namespace hcmutils
     void createDirectoryIfNecessary(const std::string &dirPath);
     void removeFileIfPresent(const std::string &path);
     std::string extractFileNameFromPath(std::string path, const std::string &extension);
+    std::vector<std::string> listFilesInDirectory(const std::string &dirPath, const std::string &extension);
+    std::vector<std::string> readLinesFromFile(const std::string &filePath);
 
     std::string getCurrentTimeString();
 
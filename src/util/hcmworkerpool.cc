@@ -0,0 +1,78 @@
+#include "hcmworkerpool.h"
+
+#include <algorithm>
+
+#include "hcmtracerecorder.h"
+
+HCMWorkerPool::HCMWorkerPool(size_t nrOfWorkers) :
+    m_pendingTasksFrameNr(hcmtrace::NO_FRAME),
+    m_unfinishedTasks(0),
+    m_shutdown(false)
+{
+    for (size_t i = 0; i < std::max<size_t>(nrOfWorkers, 1); i++)
+    {
+        m_workers.emplace_back([this] { work(); });
+    }
+}
+
+HCMWorkerPool::~HCMWorkerPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_tasksMutex);
+        m_shutdown = true;
+    }
+    m_taskAvailable.notify_all();
+
+    for (auto &worker : m_workers)
+    {
+        worker.join();
+    }
+}
+
+void HCMWorkerPool::runMultiThreaded(const std::vector<std::function<void()>> &functions)
+{
+    std::unique_lock<std::mutex> lock(m_tasksMutex);
+    for (auto &function : functions)
+    {
+        m_pendingTasks.push_back(&function);
+    }
+    m_pendingTasksFrameNr = hcmtrace::currentFrame();
+    m_unfinishedTasks += functions.size();
+    m_taskAvailable.notify_all();
+
+    m_allTasksFinished.wait(lock, [this] {
+        return m_unfinishedTasks == 0;
+    });
+}
+
+void HCMWorkerPool::work()
+{
+    hcmtrace::setThreadName("worker");
+
+    std::unique_lock<std::mutex> lock(m_tasksMutex);
+    while (true)
+    {
+        m_taskAvailable.wait(lock, [this] {
+            return !m_pendingTasks.empty() || m_shutdown;
+        });
+
+        if (m_pendingTasks.empty())
+        {
+            return; // shutdown requested and nothing left to do
+        }
+
+        const std::function<void()> *task = m_pendingTasks.front();
+        m_pendingTasks.pop_front();
+        hcmtrace::setCurrentFrame(m_pendingTasksFrameNr);
+
+        lock.unlock();
+        (*task)();
+        lock.lock();
+
+        m_unfinishedTasks--;
+        if (m_unfinishedTasks == 0)
+        {
+            m_allTasksFinished.notify_all();
+        }
+    }
+}
@@ -0,0 +1,41 @@
+#ifndef HCMLAB_WORKERPOOL_H
+#define HCMLAB_WORKERPOOL_H
+
+#include <cstdint>
+#include <vector>
+#include <deque>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+/**
+ * A fixed set of worker threads that stay alive for the lifetime of the pool.
+ * In contrast to hcmutils::runMultiThreaded no threads are created per call, which makes it cheap enough to be used per frame.
+ */
+class HCMWorkerPool
+{
+public:
+    HCMWorkerPool(size_t nrOfWorkers);
+    ~HCMWorkerPool();
+
+    /// Runs all functions concurrently on the workers of the pool and blocks until all of them have returned.
+    /// The functions must stay alive until this method returns. Their trace events belong to the calling thread's current frame.
+    void runMultiThreaded(const std::vector<std::function<void()>> &functions);
+
+private:
+    void work();
+
+    std::vector<std::thread> m_workers;
+
+    std::deque<const std::function<void()> *> m_pendingTasks;
+    int64_t m_pendingTasksFrameNr; // the trace frame of the thread that handed in the pending tasks
+    size_t m_unfinishedTasks;
+    bool m_shutdown;
+
+    std::mutex m_tasksMutex;
+    std::condition_variable m_taskAvailable;
+    std::condition_variable m_allTasksFinished;
+};
+
+#endif // HCMLAB_WORKERPOOL_H